@@ -23,7 +23,9 @@
 #include <istream>
 #include <vector>
 
+#include "bitboard.h"
 #include "position.h"
+#include "uci.h"
 
 using namespace std;
 
@@ -104,6 +106,7 @@ const vector<string> Defaults = {
 /// bench 64 4 5000 current movetime -> search current position with 4 threads for 5 sec
 /// bench 64 1 100000 default nodes -> search default positions for 100K nodes each
 /// bench 16 1 5 default perft -> run a perft 5 on default positions
+/// bench 16 1 13 positions.bin -> search the packed positions of a .bin file
 
 vector<string> setup_bench(const Position& current, istream& is) {
 
@@ -119,12 +122,34 @@ vector<string> setup_bench(const Position& current, istream& is) {
 
   go = limitType == "eval" ? "eval" : "go " + limitType + " " + limit;
 
+  // Search results depend on the piece bitbases, which must be ready
+  Bitbases::wait();
+
   if (fenFile == "default")
       fens = Defaults;
 
   else if (fenFile == "current")
       fens.push_back(current.fen());
 
+  else if (fenFile.size() > 4 && fenFile.substr(fenFile.size() - 4) == ".bin")
+  {
+      // A file of PackedPosition records, see Position::pack(). They are set
+      // up with "position packed", straight from the record.
+      ifstream file(fenFile, ios::binary);
+      PackedPosition pp;
+
+      if (!file.is_open())
+      {
+          cerr << "Unable to open file " << fenFile << endl;
+          exit(EXIT_FAILURE);
+      }
+
+      while (file.read(reinterpret_cast<char*>(&pp), sizeof(pp)))
+          fens.push_back("packed " + UCI::packed(pp));
+
+      file.close();
+  }
+
   else
   {
       string fen;
@@ -152,7 +177,7 @@ vector<string> setup_bench(const Position& current, istream& is) {
           list.emplace_back(fen);
       else
       {
-          list.emplace_back("position fen " + fen);
+          list.emplace_back(fen.find("packed ") == 0 ? "position " + fen : "position fen " + fen);
           list.emplace_back(go);
       }
 
@@ -18,11 +18,15 @@
   along with this program.  If not, see <http://www.gnu.org/licenses/>.
 */
 
+#include <atomic>
 #include <cassert>
+#include <mutex>
 #include <numeric>
+#include <thread>
 #include <vector>
 
 #include "bitboard.h"
+#include "misc.h"
 #include "types.h"
 
 namespace {
@@ -34,6 +38,12 @@ namespace {
   // Each uint32_t stores results of 32 positions, one per bit
   uint32_t KPKBitbase[MAX_INDEX / 32];
 
+  // The bitbase is computed on first probe, to save its cost at startup. This
+  // is in a KP vs K or KP vs KP search, or by the KBPK generation below.
+  std::once_flag KPKComputed;
+
+  void init_kpk();
+
   // A KPK bitbase index is an integer in [0, IndexMax] range
   //
   // Information is mapped in a way that minimizes the number of iterations:
@@ -70,6 +80,44 @@ namespace {
     Result result;
   };
 
+  // Bitbases of K + piece vs K endgames with a single pawn, which either goes
+  // with the piece (KBP vs K) or belongs to the defending side (KR vs KP and
+  // KQ vs KP). The side with the piece is white and the pawn is on files A-D.
+  // Each entry is the set of black king squares where white wins for a given
+  // side to move, pawn, white king and piece square, so that the retrograde
+  // analysis handles all the black king squares of an entry at once with a
+  // few bitboard operations.
+  constexpr int PAWN_INDEX_NB = 24; // Files A to D, ranks from 2 to 7
+
+  template<PieceType Pt, Color Pc>
+  struct PieceBitbase {
+
+    void init(size_t threadCount);
+    Bitboard white_to_move(Square wksq, Square sq, Square psq) const;
+    Bitboard black_to_move(Square wksq, Square sq, Square psq) const;
+
+    Bitboard win[COLOR_NB][PAWN_INDEX_NB][SQUARE_NB][SQUARE_NB];
+  };
+
+  // The piece bitbases are computed by a thread started by init(). Until they
+  // are ready their probes prove nothing, and the endgame functions fall back
+  // on their heuristics.
+  std::atomic_bool Stop;
+  std::thread* Generator;
+#if !defined(USE_LEAN_TABLES)
+  std::atomic_bool Ready;
+#endif
+
+  template<PieceType Pt, Color Pc>
+  PieceBitbase<Pt, Pc>& piece_bitbase() {
+    static PieceBitbase<Pt, Pc> bitbase;
+    return bitbase;
+  }
+
+  int pawn_index(Square psq) {
+    return file_of(psq) * 6 + rank_of(psq) - RANK_2;
+  }
+
 } // namespace
 
 
@@ -77,35 +125,110 @@ bool Bitbases::probe(Square wksq, Square wpsq, Square bksq, Color us) {
 
   assert(file_of(wpsq) <= FILE_D);
 
+  std::call_once(KPKComputed, init_kpk);
+
   unsigned idx = index(us, bksq, wksq, wpsq);
   return KPKBitbase[idx / 32] & (1 << (idx & 0x1F));
 }
 
 
-void Bitbases::init() {
+/// Bitbases::probe<Pt, Pc>() probes the bitbase of K + piece vs K with a pawn of
+/// color Pc. The piece side must be white and the pawn on files A-D. Only wins
+/// of the piece side are recorded, so false means the win is not proven, which
+/// is also the answer while the bitbase is being computed.
+
+template<PieceType Pt, Color Pc>
+bool Bitbases::probe(Square wksq, Square sq, Square psq, Square bksq, Color us) {
+
+  assert(file_of(psq) <= FILE_D);
+  assert(rank_of(psq) >= RANK_2 && rank_of(psq) <= RANK_7);
+
+#if defined(USE_LEAN_TABLES)
+  (void)wksq, (void)sq, (void)psq, (void)bksq, (void)us;
+  return false;
+#else
+  return Ready && (piece_bitbase<Pt, Pc>().win[us][pawn_index(psq)][wksq][sq] & bksq);
+#endif
+}
+
+template bool Bitbases::probe<BISHOP, WHITE>(Square, Square, Square, Square, Color);
+template bool Bitbases::probe<  ROOK, BLACK>(Square, Square, Square, Square, Color);
+template bool Bitbases::probe< QUEEN, BLACK>(Square, Square, Square, Square, Color);
+
+
+/// Bitbases::init() starts computing the KBPK, KRKP and KQKP bitbases in the
+/// background with the given number of threads, so that neither startup nor
+/// a search waits for them. Lean builds leave them out, saving 4.5 MB, and the
+/// endgame functions always use their heuristics.
+
+void Bitbases::init(size_t threadCount) {
+
+  memory_footprint("KPK bitbase", sizeof(KPKBitbase));
+
+#if defined(USE_LEAN_TABLES)
+  (void)threadCount;
+#else
+  memory_footprint("KBPK bitbase", sizeof(PieceBitbase<BISHOP, WHITE>));
+  memory_footprint("KRKP bitbase", sizeof(PieceBitbase<ROOK, BLACK>));
+  memory_footprint("KQKP bitbase", sizeof(PieceBitbase<QUEEN, BLACK>));
+
+  Generator = new std::thread([threadCount]() {
+
+      piece_bitbase<BISHOP, WHITE>().init(threadCount);
+      piece_bitbase<  ROOK, BLACK>().init(threadCount);
+      piece_bitbase< QUEEN, BLACK>().init(threadCount);
+
+      Ready = !Stop;
+  });
+#endif
+}
+
+
+/// Bitbases::wait() waits until the piece bitbases are ready, for the results
+/// of bench not to depend on the time taken to compute them.
+
+void Bitbases::wait() {
+
+  if (Generator && Generator->joinable())
+      Generator->join();
+}
 
-  std::vector<KPKPosition> db(MAX_INDEX);
-  unsigned idx, repeat = 1;
 
-  // Initialize db with known win / draw positions
-  for (idx = 0; idx < MAX_INDEX; ++idx)
-      db[idx] = KPKPosition(idx);
+/// Bitbases::exit() stops the computation of the piece bitbases, if still
+/// running, so that quitting does not wait for it.
 
-  // Iterate through the positions until none of the unknown positions can be
-  // changed to either wins or draws (15 cycles needed).
-  while (repeat)
-      for (repeat = idx = 0; idx < MAX_INDEX; ++idx)
-          repeat |= (db[idx] == UNKNOWN && db[idx].classify(db) != UNKNOWN);
+void Bitbases::exit() {
 
-  // Map 32 results into one KPKBitbase[] entry
-  for (idx = 0; idx < MAX_INDEX; ++idx)
-      if (db[idx] == WIN)
-          KPKBitbase[idx / 32] |= 1 << (idx & 0x1F);
+  Stop = true;
+  wait();
 }
 
 
 namespace {
 
+  // init_kpk() computes the KPK bitbase with a retrograde analysis
+  void init_kpk() {
+
+    std::vector<KPKPosition> db(MAX_INDEX);
+    unsigned idx, repeat = 1;
+
+    // Initialize db with known win / draw positions
+    for (idx = 0; idx < MAX_INDEX; ++idx)
+        db[idx] = KPKPosition(idx);
+
+    // Iterate through the positions until none of the unknown positions can be
+    // changed to either wins or draws (15 cycles needed).
+    while (repeat)
+        for (repeat = idx = 0; idx < MAX_INDEX; ++idx)
+            repeat |= (db[idx] == UNKNOWN && db[idx].classify(db) != UNKNOWN);
+
+    // Map 32 results into one KPKBitbase[] entry
+    for (idx = 0; idx < MAX_INDEX; ++idx)
+        if (db[idx] == WIN)
+            KPKBitbase[idx / 32] |= 1 << (idx & 0x1F);
+  }
+
+
   KPKPosition::KPKPosition(unsigned idx) {
 
     ksq[WHITE] = Square((idx >>  0) & 0x3F);
@@ -178,3 +301,222 @@ namespace {
   }
 
 } // namespace
+
+
+namespace {
+
+  // Squares from which a king reaches one of the given squares in one step
+  Bitboard king_span(Bitboard b) {
+    return  shift<NORTH     >(b) | shift<SOUTH     >(b) | shift<EAST      >(b)
+          | shift<WEST      >(b) | shift<NORTH_EAST>(b) | shift<NORTH_WEST>(b)
+          | shift<SOUTH_EAST>(b) | shift<SOUTH_WEST>(b);
+  }
+
+  // K + piece vs K with black to move: white wins unless black can capture
+  // the piece or is stalemated. Returns the winning black king squares.
+  template<PieceType Pt>
+  Bitboard kxk_wins(Square wksq, Square sq) {
+
+    if (Pt != ROOK && Pt != QUEEN)
+        return 0;
+
+    Bitboard occupied = wksq | sq;
+    Bitboard attacks = PseudoAttacks[KING][wksq] | attacks_bb(Pt, sq, occupied);
+
+    return  ~(occupied | PseudoAttacks[KING][wksq])
+          & ~(attacks & sq ? 0 : PseudoAttacks[KING][sq])
+          & (attacks | king_span(~(attacks | wksq)));
+  }
+
+  // A white pawn promoting to queen on qsq with black to move: white wins
+  // unless the queen is lost or black is stalemated. Underpromotions are
+  // ignored, so some wins may be missed but no draw is scored as a win.
+  template<PieceType Pt>
+  Bitboard promotion_wins(Square wksq, Square sq, Square qsq) {
+
+    Bitboard occupied = wksq | sq | qsq;
+    Bitboard defended = PseudoAttacks[KING][wksq] | attacks_bb(Pt, sq, occupied);
+    Bitboard attacks = defended | attacks_bb(QUEEN, qsq, occupied);
+
+    return  ~(occupied | PseudoAttacks[KING][wksq])
+          & ~((defended & qsq) || Pt == ROOK || Pt == QUEEN ? 0 : PseudoAttacks[KING][qsq])
+          & (attacks | king_span(~(attacks | wksq)));
+  }
+
+  // A black pawn promoting on qsq with white to move: scored as a win only
+  // when white captures the new piece at once, which is again on the safe side.
+  template<PieceType Pt>
+  Bitboard capture_promotion_wins(Square wksq, Square sq, Square qsq) {
+
+    Bitboard wins = 0;
+
+    if (PseudoAttacks[KING][wksq] & qsq)
+        wins |= kxk_wins<Pt>(qsq, sq);
+
+    if (attacks_bb(Pt, sq, wksq | sq) & qsq)
+        wins |= kxk_wins<Pt>(wksq, qsq) & ~between_bb(sq, qsq);
+
+    return wins;
+  }
+
+  template<PieceType Pt, Color Pc>
+  Bitboard PieceBitbase<Pt, Pc>::white_to_move(Square wksq, Square sq, Square psq) const {
+
+    Bitboard occupied = wksq | sq | psq;
+    Bitboard attacks = attacks_bb(Pt, sq, occupied);
+    Bitboard own = Pc == WHITE ? occupied : wksq | sq;
+    const Bitboard (*next)[SQUARE_NB] = win[BLACK][pawn_index(psq)];
+    Bitboard wins = 0;
+
+    // Black king is not in check and kings are not adjacent
+    Bitboard valid = ~(  occupied | attacks | PseudoAttacks[KING][wksq]
+                       | (Pc == WHITE ? PawnAttacks[WHITE][psq] : 0));
+
+    // King moves, capturing the black pawn leaves K + piece vs K
+    Bitboard b = PseudoAttacks[KING][wksq] & ~own;
+    while (b)
+    {
+        Square to = pop_lsb(&b);
+        wins |= to == psq ? kxk_wins<Pt>(to, sq) : next[to][sq];
+    }
+
+    // Piece moves. The black king never stands in their way, because in that
+    // case it would be in check.
+    b = attacks & ~own;
+    while (b)
+    {
+        Square to = pop_lsb(&b);
+        wins |= to == psq ? kxk_wins<Pt>(wksq, to) : next[wksq][to];
+    }
+
+    // Pawn pushes, the black king must not stand on the square in front
+    if (Pc == WHITE && !(occupied & (psq + NORTH)))
+    {
+        Square to = psq + NORTH;
+
+        wins |= ~square_bb(to) & (rank_of(to) == RANK_8 ? promotion_wins<Pt>(wksq, sq, to)
+                                                        : win[BLACK][pawn_index(to)][wksq][sq]);
+
+        if (rank_of(psq) == RANK_2 && !(occupied & (to + NORTH)))
+            wins |= ~square_bb(to) & win[BLACK][pawn_index(to + NORTH)][wksq][sq];
+    }
+
+    return valid & wins;
+  }
+
+  template<PieceType Pt, Color Pc>
+  Bitboard PieceBitbase<Pt, Pc>::black_to_move(Square wksq, Square sq, Square psq) const {
+
+    // White king can't be in check with black to move
+    if (Pc == BLACK && (PawnAttacks[BLACK][psq] & wksq))
+        return 0;
+
+    Bitboard occupied = wksq | sq | psq;
+    Bitboard attacks =  PseudoAttacks[KING][wksq] | attacks_bb(Pt, sq, occupied)
+                      | (Pc == WHITE ? PawnAttacks[WHITE][psq] : 0);
+    Bitboard valid = ~(occupied | PseudoAttacks[KING][wksq]);
+
+    // King moves: a position is won if all the legal moves lead to won
+    // positions, or if there are no legal moves and the king is in check.
+    Bitboard to = ~(attacks | wksq | (Pc == BLACK ? square_bb(psq) : 0));
+    Bitboard won = win[WHITE][pawn_index(psq)][wksq][sq];
+
+    if (Pc == WHITE)
+    {
+        if (Bitbases::probe(wksq, psq, sq, WHITE)) // Piece captured, KP vs K
+            won |= sq;
+
+        if (Pt == ROOK || Pt == QUEEN) // Pawn captured, KX vs K
+            won |= psq;
+    }
+
+    Bitboard legal = king_span(to), lost = king_span(to & ~won);
+
+    // Pawn moves, which are illegal when they expose the black king to the
+    // piece or when the black king stands in the way.
+    if (Pc == BLACK)
+    {
+        Square push = psq + SOUTH;
+
+        if (!(occupied & push))
+        {
+            Bitboard ok = ~(push | attacks_bb(Pt, sq, occupied ^ psq ^ push));
+            Bitboard wins = rank_of(push) == RANK_1 ? capture_promotion_wins<Pt>(wksq, sq, push)
+                                                    : win[WHITE][pawn_index(push)][wksq][sq];
+            legal |= ok;
+            lost |= ok & ~wins;
+
+            if (rank_of(psq) == RANK_7 && !(occupied & (push + SOUTH)))
+            {
+                ok = ~(push | (push + SOUTH) | attacks_bb(Pt, sq, occupied ^ psq ^ (push + SOUTH)));
+                legal |= ok;
+                lost |= ok & ~win[WHITE][pawn_index(push + SOUTH)][wksq][sq];
+            }
+        }
+
+        // Capturing the piece leaves a bare white king
+        if (PawnAttacks[BLACK][psq] & sq)
+            legal = lost = AllSquares;
+    }
+
+    return valid & ((attacks & ~legal) | (legal & ~lost));
+  }
+
+  // PieceBitbase::init() runs the retrograde analysis. Starting with no wins,
+  // each pass adds the positions where white to move can reach a won position,
+  // and then those where all the black moves lead to a won position. Passes
+  // are repeated until nothing changes, or until Bitbases::exit(). Each pass
+  // is split among the given number of threads by white king square; as a pass
+  // only reads the entries of the other side to move, the threads don't
+  // interfere.
+
+  template<PieceType Pt, Color Pc>
+  void PieceBitbase<Pt, Pc>::init(size_t threadCount) {
+
+    std::vector<char> changed(threadCount);
+    bool repeat = true;
+
+    while (repeat && !Stop)
+    {
+        repeat = false;
+
+        for (Color us : { WHITE, BLACK })
+        {
+            std::vector<std::thread> threads;
+
+            for (size_t idx = 0; idx < threadCount; ++idx)
+                threads.emplace_back([this, us, idx, threadCount, &changed]() {
+
+                    changed[idx] = false;
+
+                    for (size_t k = idx; k < SQUARE_NB && !Stop; k += threadCount)
+                        for (int p = 0; p < PAWN_INDEX_NB; ++p)
+                            for (Square sq = SQ_A1; sq <= SQ_H8; ++sq)
+                            {
+                                Square wksq = Square(k);
+                                Square psq = make_square(File(p / 6), Rank(RANK_2 + p % 6));
+
+                                if (wksq == sq || wksq == psq || sq == psq)
+                                    continue;
+
+                                Bitboard b = us == WHITE ? white_to_move(wksq, sq, psq)
+                                                         : black_to_move(wksq, sq, psq);
+
+                                if (b != win[us][p][wksq][sq])
+                                {
+                                    win[us][p][wksq][sq] = b;
+                                    changed[idx] = true;
+                                }
+                            }
+                });
+
+            for (std::thread& th : threads)
+                th.join();
+
+            for (char c : changed)
+                repeat |= c;
+        }
+    }
+  }
+
+} // namespace
@@ -20,15 +20,18 @@
 
 #include <algorithm>
 #include <bitset>
+#include <sstream>
 
 #include "bitboard.h"
 #include "misc.h"
 
+#if !defined(USE_LEAN_TABLES)
 uint8_t PopCnt16[1 << 16];
 uint8_t SquareDistance[SQUARE_NB][SQUARE_NB];
 
 Bitboard SquareBB[SQUARE_NB];
 Bitboard LineBB[SQUARE_NB][SQUARE_NB];
+#endif
 Bitboard PseudoAttacks[PIECE_TYPE_NB][SQUARE_NB];
 Bitboard PawnAttacks[COLOR_NB][SQUARE_NB];
 
@@ -37,10 +40,103 @@ Magic BishopMagics[SQUARE_NB];
 
 namespace {
 
+#if defined(USE_COMPACT_MAGICS)
+  uint8_t  RookTable[0x19000];  // To store indices of rook attacks
+  uint8_t  BishopTable[0x1480]; // To store indices of bishop attacks
+  Bitboard RookAttacks[4900];   // Distinct rook attacks, square by square
+  Bitboard BishopAttacks[1428]; // Distinct bishop attacks, square by square
+#elif defined(USE_PDEP_MAGICS)
+  uint16_t RookTable[0x19000];  // To store packed rook attacks
+  uint16_t BishopTable[0x1480]; // To store packed bishop attacks
+#else
   Bitboard RookTable[0x19000];  // To store rook attacks
   Bitboard BishopTable[0x1480]; // To store bishop attacks
+#endif
 
-  void init_magics(Bitboard table[], Magic magics[], Direction directions[]);
+  // Magic numbers by [Is64Bit][square]. They have been found once with a PRNG
+  // search and are embedded here to save the cost of that search at startup.
+  // The 32-bit ones only fit the 32-bit variant of Magic::index().
+  constexpr Bitboard RookMagicNumbers[2][SQUARE_NB] = {
+  {
+    0x1100400000808020ULL, 0x1100400000808020ULL, 0x00200A10E0800890ULL, 0x010A00C000800410ULL,
+    0x9080084080810404ULL, 0x04081A0481000201ULL, 0x48600480102008A1ULL, 0x8201228080801249ULL,
+    0x0100500000440204ULL, 0x1020031000200804ULL, 0x2010802000082008ULL, 0x2010802000082008ULL,
+    0x20500806801A0022ULL, 0x20500806801A0022ULL, 0x038421000A008022ULL, 0x0108442002200811ULL,
+    0x8002C02009010202ULL, 0x2041200441100040ULL, 0x2400300100004420ULL, 0x0400090210004042ULL,
+    0x0580100800080102ULL, 0x03100C0020020202ULL, 0x0005020048820101ULL, 0x2491040100000201ULL,
+    0x1080010200424021ULL, 0x3042050080908022ULL, 0x004820802C020212ULL, 0x1010006420000921ULL,
+    0x58CC050008229801ULL, 0x0014400200408901ULL, 0xC008104230680104ULL, 0x0D00048201380041ULL,
+    0x0040105040900823ULL, 0x0040105040900823ULL, 0x0080220600008610ULL, 0x0080502010008289ULL,
+    0x1640040011120008ULL, 0x0080048000A41102ULL, 0x0040010000028C4AULL, 0x0081004000009601ULL,
+    0x0020800000049050ULL, 0x2020200802409009ULL, 0x0184202200080441ULL, 0x0821000800210010ULL,
+    0x0302040201006208ULL, 0x0400402220054302ULL, 0x004020808200E001ULL, 0x0400404030110081ULL,
+    0x0040302000900080ULL, 0x60108080C0086941ULL, 0x041010200C002106ULL, 0x801180800810400AULL,
+    0x041010200C002106ULL, 0x0890C80401002004ULL, 0x11B0201000104082ULL, 0x0180028090800871ULL,
+    0x0280006104304013ULL, 0x00A1405140040221ULL, 0x2011482520086005ULL, 0x0404405290881822ULL,
+    0x12508C220A640482ULL, 0x0818211260000402ULL, 0x0012008104000A85ULL, 0x20009023018000C1ULL
+  },
+  {
+    0x0A80004000801220ULL, 0x8040004010002008ULL, 0x2080200010008008ULL, 0x1100100008210004ULL,
+    0xC200209084020008ULL, 0x2100010004000208ULL, 0x0400081000822421ULL, 0x0200010422048844ULL,
+    0x0800800080400024ULL, 0x0001402000401000ULL, 0x3000801000802001ULL, 0x4400800800100083ULL,
+    0x0904802402480080ULL, 0x4040800400020080ULL, 0x0018808042000100ULL, 0x4040800080004100ULL,
+    0x0040048001458024ULL, 0x00A0004000205000ULL, 0x3100808010002000ULL, 0x4825010010000820ULL,
+    0x5004808008000401ULL, 0x2024818004000A00ULL, 0x0005808002000100ULL, 0x2100060004806104ULL,
+    0x0080400880008421ULL, 0x4062220600410280ULL, 0x010A004A00108022ULL, 0x0000100080080080ULL,
+    0x0021000500080010ULL, 0x0044000202001008ULL, 0x0000100400080102ULL, 0xC020128200040545ULL,
+    0x0080002000400040ULL, 0x0000804000802004ULL, 0x0000120022004080ULL, 0x010A386103001001ULL,
+    0x9010080080800400ULL, 0x8440020080800400ULL, 0x0004228824001001ULL, 0x000000490A000084ULL,
+    0x0080002000504000ULL, 0x200020005000C000ULL, 0x0012088020420010ULL, 0x0010010080080800ULL,
+    0x0085001008010004ULL, 0x0002000204008080ULL, 0x0040413002040008ULL, 0x0000304081020004ULL,
+    0x0080204000800080ULL, 0x3008804000290100ULL, 0x1010100080200080ULL, 0x2008100208028080ULL,
+    0x5000850800910100ULL, 0x8402019004680200ULL, 0x0120911028020400ULL, 0x0000008044010200ULL,
+    0x0020850200244012ULL, 0x0020850200244012ULL, 0x0000102001040841ULL, 0x140900040A100021ULL,
+    0x000200282410A102ULL, 0x000200282410A102ULL, 0x000200282410A102ULL, 0x4048240043802106ULL
+  }
+  };
+
+  constexpr Bitboard BishopMagicNumbers[2][SQUARE_NB] = {
+  {
+    0x31010A0044021521ULL, 0x0080200710301002ULL, 0x4221080080049122ULL, 0x1000124640080581ULL,
+    0x84084410001450C0ULL, 0x900808020A060104ULL, 0x0848401C04C0D808ULL, 0x01100A40C3808528ULL,
+    0x4801304440803027ULL, 0x024081202006901BULL, 0x8606120002000401ULL, 0x0880102091A82404ULL,
+    0x1040002A20030A32ULL, 0x44201A0160021091ULL, 0x1008080104402244ULL, 0x0182203100450909ULL,
+    0x12100C4302280010ULL, 0x9A58410212580017ULL, 0x0142058800102009ULL, 0x0620A00400008104ULL,
+    0x0301148200010002ULL, 0x8900900800204026ULL, 0x0105200108024202ULL, 0x00420A0410804092ULL,
+    0x4802086023601201ULL, 0x1811040840B00600ULL, 0x0900C20004031000ULL, 0x2010201840004400ULL,
+    0x0080805008101440ULL, 0x0080A00C11006100ULL, 0x0424010600114904ULL, 0x0424010600114904ULL,
+    0x1220200802021804ULL, 0x0814040000015102ULL, 0x0006C10180040C04ULL, 0x401880A000000208ULL,
+    0x0812480883820042ULL, 0x0080808025149011ULL, 0x0006C10180040C04ULL, 0x0101C2007000812AULL,
+    0x2402120200880202ULL, 0x0863244230004108ULL, 0x0120820000114108ULL, 0x2090110022400099ULL,
+    0x1410020240000202ULL, 0xB040822001411001ULL, 0x020031000204012AULL, 0x81420500109001C1ULL,
+    0x0828000078040105ULL, 0x0402063624084424ULL, 0x40B0000124240049ULL, 0x504400000C040252ULL,
+    0x020A050102880092ULL, 0x100220000130A004ULL, 0x008108540051302BULL, 0x708028A2008D1044ULL,
+    0x10940401000A0101ULL, 0x0118244024002821ULL, 0x8406062000441221ULL, 0x020A020000030108ULL,
+    0x10020225200102A0ULL, 0x02C6220020400120ULL, 0x080E910800104144ULL, 0x50C200800A982129ULL
+  },
+  {
+    0x40106000A1160020ULL, 0x0020010250810120ULL, 0x2010010220280081ULL, 0x002806004050C040ULL,
+    0x0002021018000000ULL, 0x2001112010000400ULL, 0x0881010120218080ULL, 0x1030820110010500ULL,
+    0x0000120222042400ULL, 0x2000020404040044ULL, 0x8000480094208000ULL, 0x0003422A02000001ULL,
+    0x000A220210100040ULL, 0x8004820202226000ULL, 0x0018234854100800ULL, 0x0100004042101040ULL,
+    0x0004001004082820ULL, 0x0010000810010048ULL, 0x1014004208081300ULL, 0x2080818802044202ULL,
+    0x0040880C00A00100ULL, 0x0080400200522010ULL, 0x0001000188180B04ULL, 0x0080249202020204ULL,
+    0x1004400004100410ULL, 0x00013100A0022206ULL, 0x2148500001040080ULL, 0x4241080011004300ULL,
+    0x4020848004002000ULL, 0x10101380D1004100ULL, 0x0008004422020284ULL, 0x01010A1041008080ULL,
+    0x0808080400082121ULL, 0x0808080400082121ULL, 0x0091128200100C00ULL, 0x0202200802010104ULL,
+    0x8C0A020200440085ULL, 0x01A0008080B10040ULL, 0x0889520080122800ULL, 0x100902022202010AULL,
+    0x04081A0816002000ULL, 0x0000681208005000ULL, 0x8170840041008802ULL, 0x0A00004200810805ULL,
+    0x0830404408210100ULL, 0x2602208106006102ULL, 0x1048300680802628ULL, 0x2602208106006102ULL,
+    0x0602010120110040ULL, 0x0941010801043000ULL, 0x000040440A210428ULL, 0x0008240020880021ULL,
+    0x0400002012048200ULL, 0x00AC102001210220ULL, 0x0220021002009900ULL, 0x84440C080A013080ULL,
+    0x0001008044200440ULL, 0x0004C04410841000ULL, 0x2000500104011130ULL, 0x1A0C010011C20229ULL,
+    0x0044800112202200ULL, 0x0434804908100424ULL, 0x0300404822C08200ULL, 0x48081010008A2A80ULL
+  }
+  };
+
+  template<typename T>
+  void init_magics(T table[], Magic magics[], Direction directions[],
+                   const Bitboard magicNumbers[], Bitboard distinct[]);
 }
 
 
@@ -63,11 +159,62 @@ const std::string Bitboards::pretty(Bitboard b) {
 }
 
 
+/// Bitboards::magics_benchmark() reports the size of the slider attack tables
+/// in the layout chosen at build time, and times lookups with random occupancies
+/// to compare the layouts on a given hardware.
+
+const std::string Bitboards::magics_benchmark() {
+
+  constexpr int SampleCount = 4096, Rounds = 25000;
+
+  Square squares[SampleCount];
+  Bitboard occupancies[SampleCount], sink = 0;
+  PRNG rng(1070372);
+
+  for (int i = 0; i < SampleCount; ++i)
+  {
+      squares[i] = Square(rng.rand<unsigned>() % SQUARE_NB);
+      occupancies[i] = rng.rand<Bitboard>() & rng.rand<Bitboard>();
+  }
+
+  TimePoint elapsed = now();
+
+  for (int r = 0; r < Rounds; ++r)
+      for (int i = 0; i < SampleCount; ++i)
+          sink +=  attacks_bb<  ROOK>(squares[i], occupancies[i])
+                 + attacks_bb<BISHOP>(squares[i], occupancies[i]);
+
+  elapsed = now() - elapsed + 1; // Ensure positivity to avoid a 'divide by zero'
+
+  size_t lookups = 2 * size_t(SampleCount) * Rounds;
+  size_t tables = sizeof(RookTable) + sizeof(BishopTable)
+                + sizeof(RookMagics) + sizeof(BishopMagics);
+#if defined(USE_COMPACT_MAGICS)
+  tables += sizeof(RookAttacks) + sizeof(BishopAttacks);
+  const char* layout = "compact";
+#elif defined(USE_PDEP_MAGICS)
+  const char* layout = "pdep";
+#else
+  const char* layout = "fancy";
+#endif
+
+  std::stringstream ss;
+
+  ss << "Slider attacks : " << layout << (HasPext ? " with pext index" : " with magic index")
+     << "\nTable bytes    : " << tables
+     << "\nLookups        : " << lookups << " in " << elapsed << " ms (checksum " << (sink & 0xFFFF) << ")"
+     << "\nLookups/second : " << 1000 * lookups / elapsed;
+
+  return ss.str();
+}
+
+
 /// Bitboards::init() initializes various bitboard tables. It is called at
 /// startup and relies on global objects to be already zero-initialized.
 
 void Bitboards::init() {
 
+#if !defined(USE_LEAN_TABLES)
   for (unsigned i = 0; i < (1 << 16); ++i)
       PopCnt16[i] = std::bitset<16>(i).count();
 
@@ -78,6 +225,12 @@ void Bitboards::init() {
       for (Square s2 = SQ_A1; s2 <= SQ_H8; ++s2)
           SquareDistance[s1][s2] = std::max(distance<File>(s1, s2), distance<Rank>(s1, s2));
 
+  memory_footprint("PopCnt16", sizeof(PopCnt16));
+  memory_footprint("SquareDistance", sizeof(SquareDistance));
+  memory_footprint("SquareBB", sizeof(SquareBB));
+  memory_footprint("LineBB", sizeof(LineBB));
+#endif
+
   for (Square s = SQ_A1; s <= SQ_H8; ++s)
   {
       PawnAttacks[WHITE][s] = pawn_attacks_bb<WHITE>(square_bb(s));
@@ -103,19 +256,36 @@ void Bitboards::init() {
   Direction RookDirections[] = { NORTH, EAST, SOUTH, WEST };
   Direction BishopDirections[] = { NORTH_EAST, SOUTH_EAST, SOUTH_WEST, NORTH_WEST };
 
-  init_magics(RookTable, RookMagics, RookDirections);
-  init_magics(BishopTable, BishopMagics, BishopDirections);
+#if defined(USE_COMPACT_MAGICS)
+  init_magics(RookTable, RookMagics, RookDirections, RookMagicNumbers[Is64Bit], RookAttacks);
+  init_magics(BishopTable, BishopMagics, BishopDirections, BishopMagicNumbers[Is64Bit], BishopAttacks);
+#else
+  init_magics(RookTable, RookMagics, RookDirections, RookMagicNumbers[Is64Bit], nullptr);
+  init_magics(BishopTable, BishopMagics, BishopDirections, BishopMagicNumbers[Is64Bit], nullptr);
+#endif
 
   for (Square s1 = SQ_A1; s1 <= SQ_H8; ++s1)
   {
       PseudoAttacks[QUEEN][s1]  = PseudoAttacks[BISHOP][s1] = attacks_bb<BISHOP>(s1, 0);
       PseudoAttacks[QUEEN][s1] |= PseudoAttacks[  ROOK][s1] = attacks_bb<  ROOK>(s1, 0);
 
+#if !defined(USE_LEAN_TABLES)
       for (PieceType pt : { BISHOP, ROOK })
           for (Square s2 = SQ_A1; s2 <= SQ_H8; ++s2)
               if (PseudoAttacks[pt][s1] & s2)
                   LineBB[s1][s2] = (attacks_bb(pt, s1, 0) & attacks_bb(pt, s2, 0)) | s1 | s2;
+#endif
   }
+
+  memory_footprint("PseudoAttacks", sizeof(PseudoAttacks));
+  memory_footprint("PawnAttacks", sizeof(PawnAttacks));
+  memory_footprint("Magics", sizeof(RookMagics) + sizeof(BishopMagics));
+  memory_footprint("RookTable", sizeof(RookTable));
+  memory_footprint("BishopTable", sizeof(BishopTable));
+#if defined(USE_COMPACT_MAGICS)
+  memory_footprint("RookAttacks", sizeof(RookAttacks));
+  memory_footprint("BishopAttacks", sizeof(BishopAttacks));
+#endif
 }
 
 
@@ -143,16 +313,16 @@ namespace {
   // init_magics() computes all rook and bishop attacks at startup. Magic
   // bitboards are used to look up attacks of sliding pieces. As a reference see
   // www.chessprogramming.org/Magic_Bitboards. In particular, here we use the so
-  // called "fancy" approach.
+  // called "fancy" approach. With the compact layouts the table stores either
+  // the index of the attack among the distinct ones of the square, or the
+  // attack packed with pext over the attacks on an empty board.
 
-  void init_magics(Bitboard table[], Magic magics[], Direction directions[]) {
+  template<typename T>
+  void init_magics(T table[], Magic magics[], Direction directions[],
+                   const Bitboard magicNumbers[], Bitboard distinct[]) {
 
-    // Optimal PRNG seeds to pick the correct magics in the shortest time
-    int seeds[][RANK_NB] = { { 8977, 44560, 54343, 38998,  5731, 95205, 104912, 17020 },
-                             {  728, 10316, 55013, 32803, 12281, 15100,  16645,   255 } };
-
-    Bitboard occupancy[4096], reference[4096], edges, b;
-    int epoch[4096] = {}, cnt = 0, size = 0;
+    Bitboard edges, b;
+    int size = 0, count = 0;
 
     for (Square s = SQ_A1; s <= SQ_H8; ++s)
     {
@@ -167,56 +337,54 @@ namespace {
         Magic& m = magics[s];
         m.mask  = sliding_attack(directions, s, 0) & ~edges;
         m.shift = (Is64Bit ? 64 : 32) - popcount(m.mask);
+        m.magic = magicNumbers[s];
 
         // Set the offset for the attacks table of the square. We have individual
         // table sizes for each square with "Fancy Magic Bitboards".
+#if defined(USE_COMPACT_MAGICS)
+        m.indices = s == SQ_A1 ? table : magics[s - 1].indices + size;
+        m.attacks = s == SQ_A1 ? distinct : magics[s - 1].attacks + count;
+        std::fill(m.indices, m.indices + (1 << popcount(m.mask)), UINT8_MAX);
+#else
+        (void)distinct;
         m.attacks = s == SQ_A1 ? table : magics[s - 1].attacks + size;
+#endif
+#if defined(USE_PDEP_MAGICS)
+        m.emptyAttacks = sliding_attack(directions, s, 0);
+#endif
 
         // Use Carry-Rippler trick to enumerate all subsets of masks[s] and
-        // store the corresponding sliding attack bitboard in reference[].
-        b = size = 0;
+        // store the corresponding sliding attack bitboard in the database.
+        // A good magic maps two subsets to the same index only if they have
+        // the same sliding attack, and a sliding attack is never empty.
+        b = size = count = 0;
         do {
-            occupancy[size] = b;
-            reference[size] = sliding_attack(directions, s, b);
+            Bitboard attack = sliding_attack(directions, s, b);
+            unsigned idx = m.index(b);
 
-            if (HasPext)
-                m.attacks[pext(b, m.mask)] = reference[size];
+#if defined(USE_COMPACT_MAGICS)
+            int id = int(std::find(m.attacks, m.attacks + count, attack) - m.attacks);
 
-            size++;
-            b = (b - m.mask) & m.mask;
-        } while (b);
+            assert(m.indices[idx] == UINT8_MAX || m.indices[idx] == id);
 
-        if (HasPext)
-            continue;
+            if (id == count)
+                m.attacks[count++] = attack;
 
-        PRNG rng(seeds[Is64Bit][rank_of(s)]);
+            m.indices[idx] = uint8_t(id);
+#elif defined(USE_PDEP_MAGICS)
+            uint16_t packed = uint16_t(pext(attack, m.emptyAttacks));
 
-        // Find a magic for square 's' picking up an (almost) random number
-        // until we find the one that passes the verification test.
-        for (int i = 0; i < size; )
-        {
-            for (m.magic = 0; popcount((m.magic * m.mask) >> 56) < 6; )
-                m.magic = rng.sparse_rand<Bitboard>();
-
-            // A good magic must map every possible occupancy to an index that
-            // looks up the correct sliding attack in the attacks[s] database.
-            // Note that we build up the database for square 's' as a side
-            // effect of verifying the magic. Keep track of the attempt count
-            // and save it in epoch[], little speed-up trick to avoid resetting
-            // m.attacks[] after every failed attempt.
-            for (++cnt, i = 0; i < size; ++i)
-            {
-                unsigned idx = m.index(occupancy[i]);
-
-                if (epoch[idx] < cnt)
-                {
-                    epoch[idx] = cnt;
-                    m.attacks[idx] = reference[i];
-                }
-                else if (m.attacks[idx] != reference[i])
-                    break;
-            }
-        }
+            assert(!m.attacks[idx] || m.attacks[idx] == packed);
+
+            m.attacks[idx] = packed;
+#else
+            assert(!m.attacks[idx] || m.attacks[idx] == attack);
+
+            m.attacks[idx] = attack;
+#endif
+            size++;
+            b = (b - m.mask) & m.mask;
+        } while (b);
     }
   }
 }
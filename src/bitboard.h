@@ -27,15 +27,21 @@
 
 namespace Bitbases {
 
-void init();
+void init(size_t threadCount);
+void wait();
+void exit();
 bool probe(Square wksq, Square wpsq, Square bksq, Color us);
 
+template<PieceType Pt, Color Pc>
+bool probe(Square wksq, Square sq, Square psq, Square bksq, Color us);
+
 }
 
 namespace Bitboards {
 
 void init();
 const std::string pretty(Bitboard b);
+const std::string magics_benchmark();
 
 }
 
@@ -71,20 +77,36 @@ constexpr Bitboard KingFlank[FILE_NB] = {
   KingSide, KingSide, KingSide ^ FileEBB
 };
 
+// With USE_LEAN_TABLES the square tables and the 64x64 ones are not allocated,
+// their content is computed on demand instead.
+#if !defined(USE_LEAN_TABLES)
 extern uint8_t PopCnt16[1 << 16];
 extern uint8_t SquareDistance[SQUARE_NB][SQUARE_NB];
 
 extern Bitboard SquareBB[SQUARE_NB];
 extern Bitboard LineBB[SQUARE_NB][SQUARE_NB];
+#endif
 extern Bitboard PseudoAttacks[PIECE_TYPE_NB][SQUARE_NB];
 extern Bitboard PawnAttacks[COLOR_NB][SQUARE_NB];
 
 
-/// Magic holds all magic bitboards relevant data for a single square
+/// Magic holds all magic bitboards relevant data for a single square. The
+/// layout of the attacks table is chosen at build time: by default it stores
+/// the attack bitboards, with USE_COMPACT_MAGICS one byte per index into the
+/// distinct attacks of the square, and with USE_PDEP_MAGICS the attacks packed
+/// in 16 bits, to be deposited back onto the attacks on an empty board.
 struct Magic {
   Bitboard  mask;
   Bitboard  magic;
+#if defined(USE_COMPACT_MAGICS)
+  uint8_t*  indices;
   Bitboard* attacks;
+#elif defined(USE_PDEP_MAGICS)
+  uint16_t* attacks;
+  Bitboard  emptyAttacks;
+#else
+  Bitboard* attacks;
+#endif
   unsigned  shift;
 
   // Compute the attack's index using the 'magic bitboards' approach
@@ -100,6 +122,18 @@ struct Magic {
     unsigned hi = unsigned(occupied >> 32) & unsigned(mask >> 32);
     return (lo * unsigned(magic) ^ hi * unsigned(magic >> 32)) >> shift;
   }
+
+  // The compact layouts trade an extra load or a pdep for a smaller table
+  Bitboard lookup(Bitboard occupied) const {
+
+#if defined(USE_COMPACT_MAGICS)
+    return attacks[indices[index(occupied)]];
+#elif defined(USE_PDEP_MAGICS)
+    return pdep(attacks[index(occupied)], emptyAttacks);
+#else
+    return attacks[index(occupied)];
+#endif
+  }
 };
 
 extern Magic RookMagics[SQUARE_NB];
@@ -107,7 +141,11 @@ extern Magic BishopMagics[SQUARE_NB];
 
 inline Bitboard square_bb(Square s) {
   assert(s >= SQ_A1 && s <= SQ_H8);
+#if defined(USE_LEAN_TABLES)
+  return 1ULL << s;
+#else
   return SquareBB[s];
+#endif
 }
 
 /// Overloads of bitwise operators between a Bitboard and a Square for testing
@@ -195,12 +233,37 @@ inline Bitboard adjacent_files_bb(Square s) {
 }
 
 
+/// line_bb() returns the whole line, from edge to edge, passing through the
+/// given squares. If the given squares are not on a same file/rank/diagonal,
+/// return 0. The lean build picks the line from the file, rank or diagonal
+/// masks instead of the LineBB table.
+
+inline Bitboard line_bb(Square s1, Square s2) {
+
+#if defined(USE_LEAN_TABLES)
+  constexpr Bitboard MainDiagonal = 0x8040201008040201ULL;
+  constexpr Bitboard AntiDiagonal = 0x0102040810204080ULL;
+
+  int d1 = file_of(s1) - rank_of(s1), a1 = file_of(s1) + rank_of(s1) - 7;
+
+  return s1 == s2                                  ? 0
+       : file_of(s1) == file_of(s2)                ? file_bb(s1)
+       : rank_of(s1) == rank_of(s2)                ? rank_bb(s1)
+       : d1 == file_of(s2) - rank_of(s2)           ? (d1 > 0 ? MainDiagonal >> 8 * d1 : MainDiagonal << -8 * d1)
+       : a1 == file_of(s2) + rank_of(s2) - 7       ? (a1 > 0 ? AntiDiagonal << 8 * a1 : AntiDiagonal >> -8 * a1)
+                                                   : 0;
+#else
+  return LineBB[s1][s2];
+#endif
+}
+
+
 /// between_bb() returns squares that are linearly between the given squares
 /// If the given squares are not on a same file/rank/diagonal, return 0.
 
 inline Bitboard between_bb(Square s1, Square s2) {
-  return LineBB[s1][s2] & ( (AllSquares << (s1 +  (s1 < s2)))
-                           ^(AllSquares << (s2 + !(s1 < s2))));
+  return line_bb(s1, s2) & ( (AllSquares << (s1 +  (s1 < s2)))
+                            ^(AllSquares << (s2 + !(s1 < s2))));
 }
 
 
@@ -243,7 +306,7 @@ inline Bitboard passed_pawn_span(Color c, Square s) {
 /// straight or on a diagonal line.
 
 inline bool aligned(Square s1, Square s2, Square s3) {
-  return LineBB[s1][s2] & s3;
+  return line_bb(s1, s2) & s3;
 }
 
 
@@ -253,7 +316,11 @@ inline bool aligned(Square s1, Square s2, Square s3) {
 template<typename T1 = Square> inline int distance(Square x, Square y);
 template<> inline int distance<File>(Square x, Square y) { return std::abs(file_of(x) - file_of(y)); }
 template<> inline int distance<Rank>(Square x, Square y) { return std::abs(rank_of(x) - rank_of(y)); }
+#if defined(USE_LEAN_TABLES)
+template<> inline int distance<Square>(Square x, Square y) { return std::max(distance<File>(x, y), distance<Rank>(x, y)); }
+#else
 template<> inline int distance<Square>(Square x, Square y) { return SquareDistance[x][y]; }
+#endif
 
 template<class T> constexpr const T& clamp(const T& v, const T& lo, const T&  hi) {
   return v < lo ? lo : v > hi ? hi : v;
@@ -266,7 +333,7 @@ template<PieceType Pt>
 inline Bitboard attacks_bb(Square s, Bitboard occupied) {
 
   const Magic& m = Pt == ROOK ? RookMagics[s] : BishopMagics[s];
-  return m.attacks[m.index(occupied)];
+  return m.lookup(occupied);
 }
 
 inline Bitboard attacks_bb(PieceType pt, Square s, Bitboard occupied) {
@@ -287,7 +354,14 @@ inline Bitboard attacks_bb(PieceType pt, Square s, Bitboard occupied) {
 
 inline int popcount(Bitboard b) {
 
-#ifndef USE_POPCNT
+#if !defined(USE_POPCNT) && defined(USE_LEAN_TABLES)
+
+  b -= (b >> 1) & 0x5555555555555555ULL;
+  b = (b & 0x3333333333333333ULL) + ((b >> 2) & 0x3333333333333333ULL);
+  b = (b + (b >> 4)) & 0x0F0F0F0F0F0F0F0FULL;
+  return int((b * 0x0101010101010101ULL) >> 56);
+
+#elif !defined(USE_POPCNT)
 
   union { Bitboard bb; uint16_t u[4]; } v = { b };
   return PopCnt16[v.u[0]] + PopCnt16[v.u[1]] + PopCnt16[v.u[2]] + PopCnt16[v.u[3]];
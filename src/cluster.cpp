@@ -0,0 +1,697 @@
+/*
+  Stockfish, a UCI chess playing engine derived from Glaurung 2.1
+  Copyright (C) 2004-2008 Tord Romstad (Glaurung author)
+  Copyright (C) 2008-2015 Marco Costalba, Joona Kiiski, Tord Romstad
+  Copyright (C) 2015-2020 Marco Costalba, Joona Kiiski, Gary Linscott, Tord Romstad
+
+  Stockfish is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  Stockfish is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstring>
+#include <iomanip>
+#include <iostream>
+#include <memory>
+#include <mutex>
+#include <sstream>
+#include <thread>
+
+#ifndef _WIN32
+#include <arpa/inet.h>
+#include <netdb.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/socket.h>
+#include <unistd.h>
+#endif
+
+#include "cluster.h"
+#include "misc.h"
+#include "thread.h"
+#include "tt.h"
+#include "uci.h"
+
+using std::string;
+
+extern std::vector<string> setup_bench(const Position&, std::istream&);
+
+namespace Cluster {
+
+bool Active = false;     // Set once the processes are connected
+Depth ShareDepth = 10;   // Minimum depth of the shared TT entries
+
+#ifdef _WIN32
+
+void listen(std::istream&) {
+  sync_cout << "info string The cluster mode needs POSIX sockets" << sync_endl;
+}
+
+void connect(std::istream& args) { listen(args); }
+void bench(Position&, std::istream& args, StateListPtr&) { listen(args); }
+void forward(const string&) {}
+std::vector<Result> collect() { return std::vector<Result>(); }
+void report(const Search::RootMove&, Depth) {}
+void share(Key, const TTEntry&) {}
+void store() {}
+
+#else
+
+namespace {
+
+  // Messages are a type byte and a 32-bit payload size, followed by the payload:
+  // the greeting a worker sends first, a UCI command from the main process, a
+  // batch of TT records, or the result of a worker's search.
+  enum MessageType : uint8_t { HELLO, COMMAND, TT_RECORDS, RESULT };
+
+  const string Hello = "Stockfish cluster 1";
+
+  struct Record {
+    Key key;
+    uint16_t move;
+    int16_t value, eval;
+    uint8_t depth8, pvBound;
+  };
+
+  static_assert(sizeof(Record) == 16, "Unexpected Record size");
+
+  // Peer is a connection to another process: on the main process one for each
+  // worker, on a worker one to the main process.
+  struct Peer {
+    explicit Peer(int s) : fd(s) {}
+
+    int fd;
+    std::mutex sendMutex;
+    uint32_t goSent = 0, resultId = 0; // A result answers the goSent-th 'go'
+    std::atomic_bool gone { false };
+    Result result = { Search::RootMove(MOVE_NONE), 0, 0 };
+  };
+
+  constexpr size_t MaxRecords = 1 << 16; // Per batch, later ones are dropped
+  constexpr uint32_t MaxMessageSize = MaxRecords * sizeof(Record);
+  constexpr size_t MaxPending = 64; // Received batches waiting for a search
+
+  std::vector<std::unique_ptr<Peer>> Peers;
+  size_t Participants; // Workers sent the 'go' commands, fewer in a cluster bench
+  bool IsMain = false;
+  uint32_t GoReceived; // On a worker
+
+  std::mutex ResultMutex, RecordsMutex, PendingMutex;
+  std::condition_variable ResultCv;
+  std::vector<Record> Records;
+  std::vector<string> Pending;
+  std::atomic_bool HasPending;
+  thread_local bool Receiving; // Set while storing received entries
+
+
+  bool send_all(int fd, const void* data, size_t size) {
+
+    for (size_t sent = 0; sent < size; )
+    {
+        ssize_t n = send(fd, (const char*)data + sent, size - sent, MSG_NOSIGNAL);
+        if (n <= 0)
+            return false;
+        sent += size_t(n);
+    }
+    return true;
+  }
+
+  bool recv_all(int fd, void* data, size_t size) {
+
+    for (size_t got = 0; got < size; )
+    {
+        ssize_t n = recv(fd, (char*)data + got, size - got, 0);
+        if (n <= 0)
+            return false;
+        got += size_t(n);
+    }
+    return true;
+  }
+
+  bool send_message(Peer& p, MessageType type, const void* data, uint32_t size) {
+
+    char header[5] = { char(type) };
+    std::memcpy(header + 1, &size, sizeof(size));
+
+    std::unique_lock<std::mutex> lk(p.sendMutex);
+    return send_all(p.fd, header, sizeof(header)) && send_all(p.fd, data, size);
+  }
+
+  bool receive(Peer& p, MessageType& type, string& payload) {
+
+    char header[5];
+    uint32_t size;
+
+    if (!recv_all(p.fd, header, sizeof(header)))
+        return false;
+
+    type = MessageType(header[0]);
+    std::memcpy(&size, header + 1, sizeof(size));
+
+    if (size > MaxMessageSize)
+        return false;
+
+    payload.resize(size);
+
+    return recv_all(p.fd, &payload[0], size);
+  }
+
+
+  // queue() keeps a received batch until the next search stores it, because
+  // the TT may be resized or cleared between the searches.
+
+  void queue(string& payload) {
+
+    std::unique_lock<std::mutex> lk(PendingMutex);
+
+    if (Pending.size() < MaxPending)
+        Pending.push_back(std::move(payload));
+
+    HasPending = true;
+  }
+
+
+  // store_batch() writes the received records to the TT, unless the local
+  // entry of the same position is already deeper.
+
+  void store_batch(const string& payload) {
+
+    for (size_t i = 0; i + sizeof(Record) <= payload.size(); i += sizeof(Record))
+    {
+        Record r;
+        std::memcpy(&r, payload.data() + i, sizeof(Record));
+
+        Depth d = Depth(r.depth8) + DEPTH_OFFSET;
+        bool found;
+        TTEntry* tte = TT.probe(r.key, found);
+
+        if (!found || tte->depth() < d)
+            tte->save(r.key, Value(r.value), r.pvBound & 4, Bound(r.pvBound & 3),
+                      d, Move(r.move), Value(r.eval));
+    }
+  }
+
+
+  // sender() runs on its own thread and sends the TT records shared since its
+  // previous batch, every few milliseconds.
+
+  void sender() {
+
+    std::vector<Record> batch;
+
+    while (true)
+    {
+        std::this_thread::sleep_for(std::chrono::milliseconds(10));
+
+        {
+            std::unique_lock<std::mutex> lk(RecordsMutex);
+            batch.swap(Records);
+        }
+
+        if (batch.empty())
+            continue;
+
+        for (auto& p : Peers)
+            if (!p->gone)
+                send_message(*p, TT_RECORDS, batch.data(), uint32_t(batch.size() * sizeof(Record)));
+
+        batch.clear();
+    }
+  }
+
+
+  // receiver() reads the messages of a worker on the main process. The TT
+  // records are stored and relayed to the other workers.
+
+  void receiver(Peer* p) {
+
+    MessageType type;
+    string payload;
+
+    while (receive(*p, type, payload))
+        if (type == TT_RECORDS)
+        {
+            for (auto& q : Peers)
+                if (q.get() != p && !q->gone)
+                    send_message(*q, TT_RECORDS, payload.data(), uint32_t(payload.size()));
+
+            queue(payload);
+        }
+        else if (type == RESULT)
+        {
+            std::istringstream is(payload);
+            uint32_t id;
+            int score, depth;
+            uint64_t nodes;
+            string move;
+
+            is >> id >> score >> depth >> nodes;
+
+            Search::RootMove rm(MOVE_NONE);
+            rm.pv.clear();
+            rm.score = Value(score);
+
+            while (is >> move)
+                rm.pv.push_back(Move(std::stoi(move)));
+
+            std::unique_lock<std::mutex> lk(ResultMutex);
+            p->result = { rm, Depth(depth), nodes };
+            p->resultId = id;
+            ResultCv.notify_all();
+        }
+
+    std::unique_lock<std::mutex> lk(ResultMutex);
+    p->gone = true;
+    ResultCv.notify_all();
+  }
+
+
+  // set_option() runs a "setoption" command, forwarded by the main process
+  void set_option(std::istream& is) {
+
+    string token, name, value;
+    is >> token; // Consume "name" token
+
+    while (is >> token && token != "value")
+        name += (name.empty() ? "" : " ") + token;
+
+    while (is >> token)
+        value += (value.empty() ? "" : " ") + token;
+
+    if (Options.count(name))
+        Options[name] = value;
+  }
+
+  struct NullBuf : public std::streambuf {
+    int overflow(int c) override { return c; }
+  };
+
+} // namespace
+
+
+/// Cluster::listen() starts the main process of a cluster. It waits for the
+/// given number of workers, then goes back to the UCI loop:
+///
+/// cluster listen <port> [address <a>] [workers <n>] [sharedepth <d>]
+///
+/// The address is the loopback one by default, workers on other hosts need
+/// the address of a reachable interface or 0.0.0.0. A peer which does not
+/// greet with the cluster version within 5 seconds is turned away.
+
+void listen(std::istream& args) {
+
+  string token, address = "127.0.0.1";
+  int port = 0, workers = 1;
+
+  args >> port;
+
+  while (args >> token)
+      if (token == "workers")         args >> workers;
+      else if (token == "sharedepth") args >> ShareDepth;
+      else if (token == "address")    args >> address;
+
+  sockaddr_in addr = {};
+  addr.sin_family = AF_INET;
+  addr.sin_port = htons(uint16_t(port));
+
+  int yes = 1, fd = -1;
+
+  if (   inet_pton(AF_INET, address.c_str(), &addr.sin_addr) == 1
+      && (fd = socket(AF_INET, SOCK_STREAM, 0)) >= 0)
+  {
+      setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &yes, sizeof(yes));
+
+      if (bind(fd, (sockaddr*)&addr, sizeof(addr)))
+          close(fd), fd = -1;
+  }
+
+  if (fd < 0 || ::listen(fd, workers))
+  {
+      sync_cout << "info string Unable to listen on port " << port << sync_endl;
+      return;
+  }
+
+  sync_cout << "info string Waiting for " << workers << " workers on port " << port << sync_endl;
+
+  while (int(Peers.size()) < workers)
+  {
+      int s = accept(fd, nullptr, nullptr);
+      if (s < 0)
+          continue;
+
+      std::unique_ptr<Peer> p(new Peer(s));
+      MessageType type;
+      string hello;
+      timeval timeout = { 5, 0 }, none = { 0, 0 };
+
+      setsockopt(s, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+
+      if (!receive(*p, type, hello) || type != HELLO || hello != Hello)
+      {
+          close(s);
+          sync_cout << "info string Turned away a peer without the cluster greeting" << sync_endl;
+          continue;
+      }
+
+      setsockopt(s, SOL_SOCKET, SO_RCVTIMEO, &none, sizeof(none));
+      setsockopt(s, IPPROTO_TCP, TCP_NODELAY, &yes, sizeof(yes));
+      Peers.push_back(std::move(p));
+  }
+
+  close(fd);
+
+  IsMain = Active = true;
+  Participants = Peers.size();
+
+  for (auto& p : Peers)
+      std::thread(receiver, p.get()).detach();
+
+  std::thread(sender).detach();
+
+  sync_cout << "info string Cluster of " << Peers.size() + 1 << " processes" << sync_endl;
+}
+
+
+/// Cluster::connect() makes this process a worker of the cluster whose main
+/// process listens at the given host and port. It runs the commands forwarded
+/// by the main process, with the search output discarded, until the main
+/// process quits:
+///
+/// cluster connect <host> <port> [sharedepth <d>]
+
+void connect(std::istream& args) {
+
+  string host, port, token;
+  args >> host >> port;
+
+  while (args >> token)
+      if (token == "sharedepth")
+          args >> ShareDepth;
+
+  addrinfo hints = {}, *res = nullptr;
+  hints.ai_family = AF_UNSPEC;
+  hints.ai_socktype = SOCK_STREAM;
+  int fd = -1, yes = 1;
+
+  if (!getaddrinfo(host.c_str(), port.c_str(), &hints, &res))
+  {
+      for (addrinfo* ai = res; ai && fd < 0; ai = ai->ai_next)
+          if (   (fd = socket(ai->ai_family, ai->ai_socktype, ai->ai_protocol)) >= 0
+              && ::connect(fd, ai->ai_addr, ai->ai_addrlen))
+              close(fd), fd = -1;
+
+      freeaddrinfo(res);
+  }
+
+  if (fd < 0)
+  {
+      sync_cout << "info string Unable to connect to " << host << " " << port << sync_endl;
+      return;
+  }
+
+  setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &yes, sizeof(yes));
+  Peers.emplace_back(new Peer(fd));
+
+  if (!send_message(*Peers[0], HELLO, Hello.data(), uint32_t(Hello.size())))
+  {
+      sync_cout << "info string Unable to greet " << host << " " << port << sync_endl;
+      Peers.clear();
+      close(fd);
+      return;
+  }
+
+  Active = true;
+  GoReceived = 0;
+
+  std::thread(sender).detach();
+
+  NullBuf nullBuf;
+  std::cout << IO_LOCK;
+  std::streambuf* console = std::cout.rdbuf(&nullBuf);
+  std::cout << IO_UNLOCK;
+
+  Position pos;
+  StateListPtr states;
+  std::istringstream start("startpos");
+  UCI::position(pos, start, states);
+
+  MessageType type;
+  string payload;
+
+  while (receive(*Peers[0], type, payload))
+  {
+      if (type == TT_RECORDS)
+      {
+          queue(payload);
+          continue;
+      }
+
+      std::istringstream is(payload);
+      is >> token;
+
+      if (token == "quit")
+          break;
+
+      else if (token == "stop")
+          Threads.stop = true;
+
+      else if (token == "ponderhit")
+          Threads.main()->ponder = false;
+
+      else if (token == "go")
+      {
+          bool ponderMode = false;
+          Search::LimitsType limits = UCI::limits(pos, is, ponderMode);
+
+          ++GoReceived;
+          Threads.start_thinking(pos, states, limits, ponderMode);
+          continue;
+      }
+
+      Threads.main()->wait_for_search_finished();
+
+      if (token == "position")
+          UCI::position(pos, is, states);
+
+      else if (token == "setoption")
+          set_option(is);
+
+      else if (token == "ucinewgame")
+          Search::clear();
+  }
+
+  Threads.stop = true;
+  Threads.main()->wait_for_search_finished();
+  Peers[0]->gone = true;
+  Active = false;
+
+  std::cout << IO_LOCK;
+  std::cout.rdbuf(console);
+  std::cout << IO_UNLOCK;
+}
+
+
+/// Cluster::forward() sends a UCI command received by the main process to the
+/// workers, 'go' only to those which take part in the searches.
+
+void forward(const string& cmd) {
+
+  std::istringstream is(cmd);
+  string token;
+  is >> token;
+
+  if (!IsMain || (   token != "position" && token != "setoption" && token != "ucinewgame"
+                  && token != "go" && token != "stop" && token != "ponderhit" && token != "quit"))
+      return;
+
+  for (size_t i = 0; i < Peers.size(); ++i)
+      if (token != "go" || i < Participants)
+      {
+          if (token == "go")
+          {
+              std::unique_lock<std::mutex> lk(ResultMutex);
+              ++Peers[i]->goSent;
+          }
+          send_message(*Peers[i], COMMAND, cmd.data(), uint32_t(cmd.size()));
+      }
+}
+
+
+/// Cluster::collect() stops the searches of the workers at the end of a search
+/// of the main process and returns their results.
+
+std::vector<Result> collect() {
+
+  std::vector<Result> results;
+
+  if (!IsMain)
+      return results;
+
+  for (size_t i = 0; i < Participants; ++i)
+      send_message(*Peers[i], COMMAND, "stop", 4);
+
+  auto answered = [](const std::unique_ptr<Peer>& p) { return p->gone || p->resultId == p->goSent; };
+
+  std::unique_lock<std::mutex> lk(ResultMutex);
+  ResultCv.wait_for(lk, std::chrono::seconds(2), [&]{
+      return std::all_of(Peers.begin(), Peers.begin() + Participants, answered); });
+
+  for (size_t i = 0; i < Participants; ++i)
+      if (!Peers[i]->gone && Peers[i]->resultId == Peers[i]->goSent)
+          results.push_back(Peers[i]->result);
+
+  return results;
+}
+
+
+/// Cluster::report() sends the best move of a worker's search to the main
+/// process, as a text of the 'go' count, score, depth, nodes and PV moves.
+
+void report(const Search::RootMove& rm, Depth depth) {
+
+  if (IsMain || Peers.empty() || Peers[0]->gone)
+      return;
+
+  std::stringstream ss;
+  ss << GoReceived << " " << rm.score << " " << depth << " " << Threads.nodes_searched();
+
+  for (Move m : rm.pv)
+      ss << " " << int(m);
+
+  string payload = ss.str();
+  send_message(*Peers[0], RESULT, payload.data(), uint32_t(payload.size()));
+}
+
+
+/// Cluster::share() queues a TT entry written at ShareDepth or deeper for the
+/// next batch sent to the other processes.
+
+void share(Key key, const TTEntry& tte) {
+
+  if (Receiving)
+      return;
+
+  Record r = { key, uint16_t(tte.move()), int16_t(tte.value()), int16_t(tte.eval()),
+               uint8_t(tte.depth() - DEPTH_OFFSET), uint8_t(tte.is_pv() << 2 | tte.bound()) };
+
+  std::unique_lock<std::mutex> lk(RecordsMutex);
+
+  if (Records.size() < MaxRecords)
+      Records.push_back(r);
+}
+
+
+/// Cluster::store() writes the TT batches received since its previous call.
+/// It is only called by the main search thread, so that the TT is never
+/// written while it is resized or cleared.
+
+void store() {
+
+  if (!HasPending.load(std::memory_order_relaxed))
+      return;
+
+  std::vector<string> batches;
+
+  {
+      std::unique_lock<std::mutex> lk(PendingMutex);
+      batches.swap(Pending);
+      HasPending = false;
+  }
+
+  Receiving = true;
+
+  for (const string& batch : batches)
+      store_batch(batch);
+
+  Receiving = false;
+}
+
+
+/// Cluster::bench() reports the time to depth of the bench positions with the
+/// main process alone, then with one more worker at a time. The arguments are
+/// those of bench, the default limit being a depth:
+///
+/// cluster bench 16 1 16 default depth
+
+void bench(Position& pos, std::istream& args, StateListPtr& states) {
+
+  if (!IsMain)
+  {
+      sync_cout << "info string Not the main process of a cluster" << sync_endl;
+      return;
+  }
+
+  string token, benchArgs((std::istreambuf_iterator<char>(args)), std::istreambuf_iterator<char>());
+
+  if (benchArgs.find_first_not_of(" ") == string::npos)
+      benchArgs = "16 1 16 default depth";
+
+  std::istringstream is(benchArgs);
+  std::vector<string> list = setup_bench(pos, is);
+  std::vector<TimePoint> times;
+
+  for (size_t n = 0; n <= Peers.size(); ++n)
+  {
+      Participants = n;
+      TimePoint elapsed = 0;
+      uint64_t nodes = 0;
+
+      for (const string& cmd : list)
+      {
+          std::istringstream cs(cmd);
+          cs >> token;
+
+          if (token != "go" && token != "position" && token != "setoption" && token != "ucinewgame")
+              continue;
+
+          forward(cmd);
+
+          if (token == "go")
+          {
+              bool ponderMode = false;
+              TimePoint start = now();
+              Threads.start_thinking(pos, states, UCI::limits(pos, cs, ponderMode), ponderMode);
+              Threads.main()->wait_for_search_finished();
+              elapsed += now() - start;
+              nodes += Threads.nodes_searched();
+          }
+          else if (token == "position")   UCI::position(pos, cs, states);
+          else if (token == "setoption")  set_option(cs);
+          else if (token == "ucinewgame") Search::clear();
+      }
+
+      times.push_back(std::max(elapsed, TimePoint(1)));
+
+      sync_cout << "info string " << n + 1 << " processes: " << elapsed
+                << " ms, main process nodes " << nodes << sync_endl;
+  }
+
+  Participants = Peers.size();
+
+  std::stringstream ss;
+  ss << "\nProcesses  Time to depth (ms)  Speedup\n" << std::fixed << std::setprecision(2);
+
+  for (size_t n = 0; n < times.size(); ++n)
+      ss << std::setw(9) << n + 1 << std::setw(20) << times[n]
+         << std::setw(9) << double(times[0]) / times[n] << "\n";
+
+  sync_cout << ss.str() << sync_endl;
+}
+
+#endif
+
+} // namespace Cluster
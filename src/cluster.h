@@ -0,0 +1,63 @@
+/*
+  Stockfish, a UCI chess playing engine derived from Glaurung 2.1
+  Copyright (C) 2004-2008 Tord Romstad (Glaurung author)
+  Copyright (C) 2008-2015 Marco Costalba, Joona Kiiski, Tord Romstad
+  Copyright (C) 2015-2020 Marco Costalba, Joona Kiiski, Gary Linscott, Tord Romstad
+
+  Stockfish is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  Stockfish is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+
+#ifndef CLUSTER_H_INCLUDED
+#define CLUSTER_H_INCLUDED
+
+#include <istream>
+#include <string>
+#include <vector>
+
+#include "position.h"
+#include "search.h"
+#include "types.h"
+
+struct TTEntry;
+
+/// A cluster is a main process, which talks UCI to the GUI, and worker
+/// processes connected to it by sockets, possibly on other hosts. The workers
+/// search the same root as the main process, and all of them exchange their
+/// deep transposition table entries through the main process.
+
+namespace Cluster {
+
+/// Result is the best move of a worker at the end of a search, with its depth
+struct Result {
+  Search::RootMove rootMove;
+  Depth depth;
+  uint64_t nodes;
+};
+
+extern bool Active;
+extern Depth ShareDepth;
+
+void listen(std::istream& args);
+void connect(std::istream& args);
+void bench(Position& pos, std::istream& args, StateListPtr& states);
+void forward(const std::string& cmd);
+std::vector<Result> collect();
+void report(const Search::RootMove& rm, Depth depth);
+void share(Key key, const TTEntry& tte);
+void store();
+
+} // namespace Cluster
+
+#endif // #ifndef CLUSTER_H_INCLUDED
@@ -22,6 +22,7 @@
 
 #include "bitboard.h"
 #include "endgame.h"
+#include "misc.h"
 #include "movegen.h"
 
 using std::string;
@@ -67,24 +68,28 @@ namespace {
   }
 #endif
 
-  // Map the square as if strongSide is white and strongSide's only pawn
+  // Map the square as if strongSide is white and pawnSide's only pawn
   // is on the left half of the board.
-  Square normalize(const Position& pos, Color strongSide, Square sq) {
+  Square normalize(const Position& pos, Color strongSide, Square sq, Color pawnSide) {
 
-    assert(pos.count<PAWN>(strongSide) == 1);
+    assert(pos.count<PAWN>(pawnSide) == 1);
 
-    if (file_of(pos.square<PAWN>(strongSide)) >= FILE_E)
+    if (file_of(pos.square<PAWN>(pawnSide)) >= FILE_E)
         sq = Square(int(sq) ^ 7); // Mirror SQ_H1 -> SQ_A1
 
     return strongSide == WHITE ? sq : ~sq;
   }
 
+  Square normalize(const Position& pos, Color strongSide, Square sq) {
+    return normalize(pos, strongSide, sq, strongSide);
+  }
+
 } // namespace
 
 
 namespace Endgames {
 
-  std::pair<Map<Value>, Map<ScaleFactor>> maps;
+  std::pair<Table<Value>, Table<ScaleFactor>> tables;
 
   void init() {
 
@@ -106,6 +111,8 @@ namespace Endgames {
     add<KBPKN>("KBPKN");
     add<KBPPKB>("KBPPKB");
     add<KRPPKRP>("KRPPKRP");
+
+    memory_footprint("Endgames", sizeof(tables));
   }
 }
 
@@ -190,46 +197,61 @@ Value Endgame<KPK>::operator()(const Position& pos) const {
 }
 
 
-/// KR vs KP. This is a somewhat tricky endgame to evaluate precisely without
-/// a bitbase. The function below returns drawish scores when the pawn is
-/// far advanced with support of the king, while the attacking king is far
-/// away.
+/// KR vs KP. Wins proven by the bitbase are scored as such, with the stronger
+/// side's king driven towards the pawn. In other positions the function below
+/// returns drawish scores when the pawn is far advanced with support of the
+/// king, while the attacking king is far away.
 template<>
 Value Endgame<KRKP>::operator()(const Position& pos) const {
 
   assert(verify_material(pos, strongSide, RookValueMg, 0));
   assert(verify_material(pos, weakSide, VALUE_ZERO, 1));
 
-  Square wksq = relative_square(strongSide, pos.square<KING>(strongSide));
-  Square bksq = relative_square(strongSide, pos.square<KING>(weakSide));
-  Square rsq  = relative_square(strongSide, pos.square<ROOK>(strongSide));
-  Square psq  = relative_square(strongSide, pos.square<PAWN>(weakSide));
-
-  Square queeningSq = make_square(file_of(psq), RANK_1);
-  Value result;
-
-  // If the stronger side's king is in front of the pawn, it's a win
-  if (forward_file_bb(WHITE, wksq) & psq)
-      result = RookValueEg - distance(wksq, psq);
+  // Assume strongSide is white and the pawn is on files A-D
+  Square wksq = normalize(pos, strongSide, pos.square<KING>(strongSide), weakSide);
+  Square bksq = normalize(pos, strongSide, pos.square<KING>(weakSide), weakSide);
+  Square rsq  = normalize(pos, strongSide, pos.square<ROOK>(strongSide), weakSide);
+  Square psq  = normalize(pos, strongSide, pos.square<PAWN>(weakSide), weakSide);
 
-  // If the weaker side's king is too far from the pawn and the rook,
-  // it's a win.
-  else if (   distance(bksq, psq) >= 3 + (pos.side_to_move() == weakSide)
-           && distance(bksq, rsq) >= 3)
-      result = RookValueEg - distance(wksq, psq);
+  Color us = strongSide == pos.side_to_move() ? WHITE : BLACK;
 
-  // If the pawn is far advanced and supported by the defending king,
-  // the position is drawish
-  else if (   rank_of(bksq) <= RANK_3
-           && distance(bksq, psq) == 1
-           && rank_of(wksq) >= RANK_4
-           && distance(wksq, psq) > 2 + (pos.side_to_move() == strongSide))
-      result = Value(80) - 8 * distance(wksq, psq);
+  Value result;
 
+  // The bitbase only proves wins, otherwise fall back to the heuristics below
+  if (Bitbases::probe<ROOK, BLACK>(wksq, rsq, psq, bksq, us))
+      result = RookValueEg - PawnValueEg + PushClose[distance(wksq, psq)];
   else
-      result =  Value(200) - 8 * (  distance(wksq, psq + SOUTH)
-                                  - distance(bksq, psq + SOUTH)
-                                  - distance(psq, queeningSq));
+  {
+      wksq = relative_square(strongSide, pos.square<KING>(strongSide));
+      bksq = relative_square(strongSide, pos.square<KING>(weakSide));
+      rsq  = relative_square(strongSide, pos.square<ROOK>(strongSide));
+      psq  = relative_square(strongSide, pos.square<PAWN>(weakSide));
+
+      Square queeningSq = make_square(file_of(psq), RANK_1);
+
+      // If the stronger side's king is in front of the pawn, it's a win
+      if (forward_file_bb(WHITE, wksq) & psq)
+          result = RookValueEg - distance(wksq, psq);
+
+      // If the weaker side's king is too far from the pawn and the rook,
+      // it's a win.
+      else if (   distance(bksq, psq) >= 3 + (pos.side_to_move() == weakSide)
+               && distance(bksq, rsq) >= 3)
+          result = RookValueEg - distance(wksq, psq);
+
+      // If the pawn is far advanced and supported by the defending king,
+      // the position is drawish
+      else if (   rank_of(bksq) <= RANK_3
+               && distance(bksq, psq) == 1
+               && rank_of(wksq) >= RANK_4
+               && distance(wksq, psq) > 2 + (pos.side_to_move() == strongSide))
+          result = Value(80) - 8 * distance(wksq, psq);
+
+      else
+          result =  Value(200) - 8 * (  distance(wksq, psq + SOUTH)
+                                      - distance(bksq, psq + SOUTH)
+                                      - distance(psq, queeningSq));
+  }
 
   return strongSide == pos.side_to_move() ? result : -result;
 }
@@ -264,24 +286,31 @@ Value Endgame<KRKN>::operator()(const Position& pos) const {
 
 
 /// KQ vs KP. In general, this is a win for the stronger side, but there are a
-/// few important exceptions. A pawn on 7th rank and on the A,C,F or H files
-/// with a king positioned next to it can be a draw, so in that case, we only
-/// use the distance between the kings.
+/// few important exceptions, like a pawn on 7th rank and on the A,C,F or H files
+/// with a king positioned next to it, where we only use the distance between
+/// the kings unless the bitbase proves a win.
 template<>
 Value Endgame<KQKP>::operator()(const Position& pos) const {
 
   assert(verify_material(pos, strongSide, QueenValueMg, 0));
   assert(verify_material(pos, weakSide, VALUE_ZERO, 1));
 
-  Square winnerKSq = pos.square<KING>(strongSide);
-  Square loserKSq = pos.square<KING>(weakSide);
-  Square pawnSq = pos.square<PAWN>(weakSide);
+  // Assume strongSide is white and the pawn is on files A-D
+  Square wksq = normalize(pos, strongSide, pos.square<KING>(strongSide), weakSide);
+  Square bksq = normalize(pos, strongSide, pos.square<KING>(weakSide), weakSide);
+  Square qsq  = normalize(pos, strongSide, pos.square<QUEEN>(strongSide), weakSide);
+  Square psq  = normalize(pos, strongSide, pos.square<PAWN>(weakSide), weakSide);
+
+  Color us = strongSide == pos.side_to_move() ? WHITE : BLACK;
 
-  Value result = Value(PushClose[distance(winnerKSq, loserKSq)]);
+  Value result = Value(PushClose[distance(wksq, bksq)]);
 
-  if (   relative_rank(weakSide, pawnSq) != RANK_7
-      || distance(loserKSq, pawnSq) != 1
-      || !((FileABB | FileCBB | FileFBB | FileHBB) & pawnSq))
+  // The bitbase only proves wins. Otherwise a pawn on 7th rank and on the
+  // A, C, F or H files with a king next to it is scored as a likely draw.
+  if (   Bitbases::probe<QUEEN, BLACK>(wksq, qsq, psq, bksq, us)
+      || relative_rank(weakSide, pos.square<PAWN>(weakSide)) != RANK_7
+      || distance(bksq, psq) != 1
+      || !((FileABB | FileCBB | FileFBB | FileHBB) & pos.square<PAWN>(weakSide)))
       result += QueenValueEg - PawnValueEg;
 
   return strongSide == pos.side_to_move() ? result : -result;
@@ -342,6 +371,24 @@ ScaleFactor Endgame<KBPsK>::operator()(const Position& pos) const {
   // No assertions about the material of weakSide, because we want draws to
   // be detected even when the weaker side has some pawns.
 
+  // KB and a single pawn vs K is a win if the bitbase says so. The bitbase
+  // only proves wins, other positions are left to the rules below.
+  if (   pos.count<PAWN>(strongSide) == 1
+      && !pos.count<PAWN>(weakSide)
+      && !pos.non_pawn_material(weakSide))
+  {
+      // Assume strongSide is white and the pawn is on files A-D
+      Square wksq = normalize(pos, strongSide, pos.square<KING>(strongSide));
+      Square bksq = normalize(pos, strongSide, pos.square<KING>(weakSide));
+      Square bsq  = normalize(pos, strongSide, pos.square<BISHOP>(strongSide));
+      Square psq  = normalize(pos, strongSide, pos.square<PAWN>(strongSide));
+
+      Color us = strongSide == pos.side_to_move() ? WHITE : BLACK;
+
+      if (Bitbases::probe<BISHOP, WHITE>(wksq, bsq, psq, bksq, us))
+          return SCALE_FACTOR_NONE;
+  }
+
   Bitboard pawns = pos.pieces(strongSide, PAWN);
   File pawnsFile = file_of(lsb(pawns));
 
@@ -21,8 +21,6 @@
 #ifndef ENDGAME_H_INCLUDED
 #define ENDGAME_H_INCLUDED
 
-#include <unordered_map>
-#include <memory>
 #include <string>
 #include <type_traits>
 #include <utility>
@@ -70,57 +68,96 @@ template<EndgameCode E> using
 eg_type = typename std::conditional<(E < SCALING_FUNCTIONS), Value, ScaleFactor>::type;
 
 
-/// Base and derived functors for endgame evaluation and scaling functions
+/// Base and derived functors for endgame evaluation and scaling functions. The
+/// base functor has no virtual functions: it dispatches through a pointer to a
+/// static function of the derived one, set at construction.
 
 template<typename T>
 struct EndgameBase {
 
-  explicit EndgameBase(Color c) : strongSide(c), weakSide(~c) {}
-  virtual ~EndgameBase() = default;
-  virtual T operator()(const Position&) const = 0;
+  typedef T (*Fn)(const EndgameBase&, const Position&);
+
+  EndgameBase(Color c, Fn f) : strongSide(c), weakSide(~c), fn(f) {}
+  T operator()(const Position& pos) const { return fn(*this, pos); }
 
   const Color strongSide, weakSide;
+
+private:
+  const Fn fn;
 };
 
 
 template<EndgameCode E, typename T = eg_type<E>>
 struct Endgame : public EndgameBase<T> {
 
-  explicit Endgame(Color c) : EndgameBase<T>(c) {}
-  T operator()(const Position&) const override;
+  explicit Endgame(Color c) : EndgameBase<T>(c, call) {}
+  T operator()(const Position&) const;
+
+private:
+  static T call(const EndgameBase<T>& eb, const Position& pos) {
+    return static_cast<const Endgame&>(eb)(pos);
+  }
 };
 
 
 /// The Endgames namespace handles the pointers to endgame evaluation and scaling
-/// base objects in two std::map. We use polymorphism to invoke the actual
-/// endgame function by calling its virtual operator().
+/// functors in two flat tables indexed by material key, filled once by init().
+/// Collisions are resolved by linear probing, and the tables are sized so that
+/// most lookups, including the misses of the common case, touch a single slot.
 
 namespace Endgames {
 
-  template<typename T> using Ptr = std::unique_ptr<EndgameBase<T>>;
-  template<typename T> using Map = std::unordered_map<Key, Ptr<T>>;
+  template<typename T>
+  struct Table {
+
+    static constexpr size_t Size = 128; // Power of 2, well above the number of keys
+
+    const EndgameBase<T>* probe(Key key) const {
+      for (size_t i = key & (Size - 1); slots[i].eg; i = (i + 1) & (Size - 1))
+          if (slots[i].key == key)
+              return slots[i].eg;
 
-  extern std::pair<Map<Value>, Map<ScaleFactor>> maps;
+      return nullptr;
+    }
+
+    void insert(Key key, const EndgameBase<T>* eg) {
+      size_t i = key & (Size - 1);
+
+      while (slots[i].eg && slots[i].key != key)
+          i = (i + 1) & (Size - 1);
+
+      slots[i] = { key, eg };
+    }
+
+  private:
+    struct Slot {
+      Key key;
+      const EndgameBase<T>* eg;
+    } slots[Size];
+  };
+
+  extern std::pair<Table<Value>, Table<ScaleFactor>> tables;
 
   void init();
 
   template<typename T>
-  Map<T>& map() {
-    return std::get<std::is_same<T, ScaleFactor>::value>(maps);
+  Table<T>& table() {
+    return std::get<std::is_same<T, ScaleFactor>::value>(tables);
   }
 
   template<EndgameCode E, typename T = eg_type<E>>
   void add(const std::string& code) {
 
+    static const Endgame<E> eg[] = { Endgame<E>(WHITE), Endgame<E>(BLACK) };
+
     StateInfo st;
-    map<T>()[Position().set(code, WHITE, &st).material_key()] = Ptr<T>(new Endgame<E>(WHITE));
-    map<T>()[Position().set(code, BLACK, &st).material_key()] = Ptr<T>(new Endgame<E>(BLACK));
+    table<T>().insert(Position().set(code, WHITE, &st).material_key(), &eg[WHITE]);
+    table<T>().insert(Position().set(code, BLACK, &st).material_key(), &eg[BLACK]);
   }
 
   template<typename T>
   const EndgameBase<T>* probe(Key key) {
-    auto it = map<T>().find(key);
-    return it != map<T>().end() ? it->second.get() : nullptr;
+    return table<T>().probe(key);
   }
 }
 
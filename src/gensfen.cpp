@@ -0,0 +1,259 @@
+/*
+  Stockfish, a UCI chess playing engine derived from Glaurung 2.1
+  Copyright (C) 2004-2008 Tord Romstad (Glaurung author)
+  Copyright (C) 2008-2015 Marco Costalba, Joona Kiiski, Tord Romstad
+  Copyright (C) 2015-2020 Marco Costalba, Joona Kiiski, Gary Linscott, Tord Romstad
+
+  Stockfish is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  Stockfish is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <cstdlib>
+#include <fstream>
+#include <iostream>
+#include <mutex>
+#include <sstream>
+#include <vector>
+
+#include "misc.h"
+#include "movegen.h"
+#include "position.h"
+#include "search.h"
+#include "thread.h"
+#include "tt.h"
+#include "uci.h"
+
+using namespace std;
+
+namespace {
+
+const char* StartFEN = "rnbqkbnr/pppppppp/8/8/8/8/PPPPPPPP/RNBQKBNR w KQkq - 0 1";
+
+/// TrainingRecord is the 40-byte record written by gensfen for each searched
+/// position: the position, the search score and best move from the side to
+/// move's point of view, and the game result for the side to move (1 win,
+/// 0 draw, -1 loss). Fields are in host byte order.
+
+struct TrainingRecord {
+  PackedPosition pos;
+  int16_t score;
+  uint16_t move;
+  uint16_t gamePly;
+  int8_t result;
+  uint8_t padding;
+};
+
+static_assert(sizeof(TrainingRecord) == 40, "TrainingRecord must be 40 bytes");
+
+struct Params {
+  int64_t count = 1000000;
+  int randomPlies = 8;
+  int maxPly = 400;
+  int evalLimit = 3000;
+  uint64_t seed = 1;
+  string output = "training.bin";
+};
+
+
+/// Writer collects the records of the games finished by all the threads and
+/// writes them to the output file, until the requested count is reached.
+
+class Writer {
+public:
+  Writer(const Params& p) : file(p.output, ios::binary), target(p.count), start(now()) {}
+
+  bool is_open() const { return file.is_open(); }
+  bool done() const { return written >= target; }
+  int64_t positions() const { return written; }
+  int64_t games_played() const { return games; }
+
+  void write(const vector<TrainingRecord>& records) {
+
+    std::lock_guard<std::mutex> lk(mutex);
+
+    size_t n = size_t(std::min(int64_t(records.size()), target - written));
+    file.write(reinterpret_cast<const char*>(records.data()), n * sizeof(TrainingRecord));
+
+    int64_t step = std::max(target / 10, int64_t(1));
+    bool report = (written + int64_t(n)) / step != written / step;
+
+    written += n;
+    games += n > 0;
+
+    if (report)
+        sync_cout << "info string gensfen " << written << " positions, "
+                  << 1000 * written / (now() - start + 1) << " positions/s" << sync_endl;
+  }
+
+private:
+  std::mutex mutex;
+  ofstream file;
+  std::atomic<int64_t> written { 0 };
+  int64_t games = 0, target;
+  TimePoint start;
+};
+
+
+/// search() runs an iterative deepening search of 'pos' on the given thread
+/// alone, within Search::Limits, and returns the score and the best move.
+
+Value search(Thread* th, Position& pos, StateListPtr& states, Move& bestMove) {
+
+  // As in ThreadPool::start_thinking(), the root state keeps its link to the
+  // game history for repetition detection.
+  StateInfo tmp = states->back();
+  th->rootPos.set_packed(pos.pack(), pos.is_chess960(), &states->back(), th);
+  states->back() = tmp;
+
+  th->rootMoves.clear();
+  for (const auto& m : MoveList<LEGAL>(pos))
+      th->rootMoves.emplace_back(m);
+
+  th->nodes = th->tbHits = th->nmpMinPly = 0;
+  th->rootDepth = th->completedDepth = 0;
+  th->Thread::search();
+
+  bestMove = th->rootMoves[0].pv[0];
+  return th->rootMoves[0].score;
+}
+
+
+/// play_games() is run by each thread: it plays games against itself until the
+/// writer has enough positions. The first plies are random legal moves, then
+/// each position is searched and recorded, and the best move is played. Games
+/// end by the rules, at maxPly or when the score reaches evalLimit.
+
+void play_games(Thread* th, const Params& p, Writer& writer, uint64_t seed) {
+
+  PRNG rng(seed);
+  vector<TrainingRecord> records;
+  Position pos;
+
+  while (!writer.done())
+  {
+      StateListPtr states(new std::deque<StateInfo>(1));
+      int result = 0; // From White's point of view
+
+      pos.set(StartFEN, false, &states->back(), th);
+      records.clear();
+
+      for (int ply = 0; ; ++ply)
+      {
+          MoveList<LEGAL> moves(pos);
+          Color us = pos.side_to_move();
+          Move m;
+
+          if (!moves.size())
+          {
+              result = pos.checkers() ? (us == WHITE ? -1 : 1) : 0;
+              break;
+          }
+
+          if (ply >= p.maxPly || pos.is_draw(ply))
+              break;
+
+          if (ply < p.randomPlies)
+              m = moves.begin()[rng.rand<uint64_t>() % moves.size()];
+          else
+          {
+              Value v = search(th, pos, states, m);
+
+              records.push_back({ pos.pack(), int16_t(v), uint16_t(m), uint16_t(pos.game_ply()), 0, 0 });
+
+              if (abs(v) >= p.evalLimit)
+              {
+                  result = (v > 0) == (us == WHITE) ? 1 : -1;
+                  break;
+              }
+          }
+
+          states->emplace_back();
+          pos.do_move(m, states->back());
+      }
+
+      for (TrainingRecord& r : records)
+          r.result = int8_t(r.pos.sideToMove == WHITE ? result : -result);
+
+      writer.write(records);
+  }
+}
+
+} // namespace
+
+
+/// gensfen() is called when the engine receives the "gensfen" command. All the
+/// threads of the pool play self-play games independently, each searching with
+/// the given depth or node limit per move (soft limit, checked between
+/// iterations), and the positions are written to a file of TrainingRecord.
+///
+/// gensfen depth 8 count 1000000 output games.bin
+/// gensfen nodes 20000 random 10 maxply 300 evallimit 2000 seed 42
+
+void gensfen(istream& is) {
+
+  Params p;
+  Search::LimitsType limits;
+  string token;
+
+  while (is >> token)
+      if (token == "depth")          is >> limits.depth;
+      else if (token == "nodes")     is >> limits.nodes;
+      else if (token == "count")     is >> p.count;
+      else if (token == "random")    is >> p.randomPlies;
+      else if (token == "maxply")    is >> p.maxPly;
+      else if (token == "evallimit") is >> p.evalLimit;
+      else if (token == "seed")      is >> p.seed;
+      else if (token == "output")    is >> p.output;
+
+  if (!limits.depth && !limits.nodes)
+      limits.depth = 6;
+
+  Writer writer(p);
+
+  if (!writer.is_open())
+  {
+      sync_cout << "Unable to open file " << p.output << sync_endl;
+      return;
+  }
+
+  Threads.main()->wait_for_search_finished();
+
+  limits.startTime = now();
+  Search::Limits = limits;
+  Threads.stop = false;
+  Threads.increaseDepth = true;
+  Threads.selfPlay = true;
+  TT.new_search();
+
+  TimePoint elapsed = now();
+
+  for (size_t i = 0; i < Threads.size(); ++i)
+  {
+      Thread* th = Threads[i];
+      uint64_t seed = p.seed * 6364136223846793005ULL + i + 1;
+      th->start_job([th, &p, &writer, seed]() { play_games(th, p, writer, seed); });
+  }
+
+  for (Thread* th : Threads)
+      th->wait_for_search_finished();
+
+  Threads.selfPlay = false;
+  elapsed = now() - elapsed + 1; // Ensure positivity to avoid a 'divide by zero'
+
+  cerr << "\n==========================="
+       << "\nThreads          : " << Threads.size()
+       << "\nGames            : " << writer.games_played()
+       << "\nPositions        : " << writer.positions()
+       << "\nTotal time (ms)  : " << elapsed
+       << "\nPositions/second : " << 1000 * writer.positions() / elapsed << endl;
+}
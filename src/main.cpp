@@ -18,9 +18,12 @@
   along with this program.  If not, see <http://www.gnu.org/licenses/>.
 */
 
+#include <algorithm>
 #include <iostream>
+#include <thread>
 
 #include "bitboard.h"
+#include "material.h"
 #include "position.h"
 #include "search.h"
 #include "thread.h"
@@ -35,19 +38,26 @@ namespace PSQT {
 
 int main(int argc, char* argv[]) {
 
+  Output::start();
   std::cout << engine_info() << std::endl;
 
-  UCI::init(Options);
-  PSQT::init();
-  Bitboards::init();
-  Position::init();
-  Bitbases::init();
-  Endgames::init();
-  Threads.set(Options["Threads"]);
-  Search::clear(); // After threads are up
+  // Thread data and hash tables are reset when threads are created, and the
+  // material table is filled on first use. The piece bitbases are computed in
+  // the background with all the cores.
+  size_t cores = std::max(std::thread::hardware_concurrency(), 1U);
+
+  UCI::init(Options);              startup_step("UCI::init");
+  PSQT::init();                    startup_step("PSQT::init");
+  Bitboards::init();               startup_step("Bitboards::init");
+  Bitbases::init(cores);           startup_step("Bitbases::init");
+  Position::init();                startup_step("Position::init");
+  Endgames::init();                startup_step("Endgames::init");
+  Material::init();                startup_step("Material::init");
+  Threads.set(Options["Threads"]); startup_step("Threads.set");
 
   UCI::loop(argc, argv);
 
+  Bitbases::exit();
   Threads.set(0);
   return 0;
 }
@@ -0,0 +1,401 @@
+/*
+  Stockfish, a UCI chess playing engine derived from Glaurung 2.1
+  Copyright (C) 2004-2008 Tord Romstad (Glaurung author)
+  Copyright (C) 2008-2015 Marco Costalba, Joona Kiiski, Tord Romstad
+  Copyright (C) 2015-2020 Marco Costalba, Joona Kiiski, Gary Linscott, Tord Romstad
+
+  Stockfish is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  Stockfish is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+
+#include <algorithm>
+#include <iostream>
+#include <vector>
+
+#include "mate.h"
+#include "movegen.h"
+#include "thread.h"
+#include "timeman.h"
+#include "uci.h"
+
+namespace {
+
+  // A depth-first proof-number search (df-pn) answers the 'go mate N' question
+  // directly: the side to move at the root, the attacker, is trying to prove a
+  // mate within 2N-1 plies, the defender to disprove it. Every node keeps two
+  // numbers from the point of view of its side to move: phi, the number of
+  // leaves still to be solved to prove a win, and delta, to prove a loss. For a
+  // defender a win means to escape the mate. Proof and disproof numbers are
+  // only valid for the number of plies left they were computed with, which the
+  // table entries record.
+
+  constexpr uint32_t INF = 1 << 30;
+
+  struct Entry {
+    Key key;
+    uint32_t phi, delta, work;
+    uint16_t length; // Plies to the end of the line, for a solved node
+    uint8_t pliesLeft, generation;
+  };
+
+  static_assert(sizeof(Entry) == 24, "Unexpected Entry size");
+
+  // Table is the proof and disproof hash, separate from the transposition
+  // table and sized by the "Mate Hash" option. It is allocated by the first
+  // solve and released by clear(). Entries of a previous solve are discarded
+  // by their generation, so that batches of puzzles do not pay for a memset of
+  // the table each time.
+
+  class Table {
+
+    static constexpr int BucketSize = 4;
+
+    std::vector<Entry> entries;
+    uint8_t generation = 0;
+
+  public:
+    void new_solve(size_t mbSize) {
+
+      size_t count = mbSize * 1024 * 1024 / sizeof(Entry) / BucketSize * BucketSize;
+
+      if (entries.size() != count)
+          entries = std::vector<Entry>(count);
+
+      if (++generation == 0) // Never use 0, the generation of empty entries
+          ++generation;
+    }
+
+    void clear() { entries = std::vector<Entry>(); }
+
+    Entry* bucket(Key key) {
+      return &entries[(key % (entries.size() / BucketSize)) * BucketSize];
+    }
+
+    const Entry* probe(Key key, int pliesLeft) {
+
+      Entry* e = bucket(key);
+
+      for (int i = 0; i < BucketSize; ++i)
+          if (   e[i].key == key
+              && e[i].pliesLeft == pliesLeft
+              && e[i].generation == generation)
+              return &e[i];
+
+      return nullptr;
+    }
+
+    // store() overwrites the entry of the same node if any, then an entry of a
+    // previous solve, then the entry that needed the least work to compute.
+    void store(Key key, int pliesLeft, uint32_t phi, uint32_t delta, uint32_t work, int length) {
+
+      Entry* e = bucket(key);
+      Entry* replace = e;
+
+      for (int i = 0; i < BucketSize; ++i)
+      {
+          if (e[i].generation != generation || (e[i].key == key && e[i].pliesLeft == pliesLeft))
+          {
+              replace = &e[i];
+              break;
+          }
+
+          if (e[i].work < replace->work)
+              replace = &e[i];
+      }
+
+      *replace = { key, phi, delta, work, uint16_t(length), uint8_t(pliesLeft), generation };
+    }
+  };
+
+  Table PNTable;
+
+
+  struct Child {
+    Move move;
+    Key key;
+    uint32_t phi, delta;
+    int length;
+    bool solved; // Terminal node, decided by the rules and not stored
+  };
+
+  // Solver runs the search on the root position. MID ("multiple iterative
+  // deepening") expands a node and searches its most proving child until the
+  // node's numbers reach the thresholds, as in Nagai's df-pn.
+
+  class Solver {
+
+  public:
+    Solver(Position& p, const Search::RootMoves& rm) : pos(p), rootMoves(rm) {}
+
+    void mid(int ply, int pliesLeft, uint32_t thPhi, uint32_t thDelta);
+    void extract_pv(int pliesLeft, std::vector<Move>& pv);
+    bool aborted() const { return stop; }
+
+    uint64_t nodes = 0; // Expanded nodes, the positions visited are counted by do_move()
+
+  private:
+    void expand(int ply, int pliesLeft, std::vector<Child>& children);
+    void check_limits();
+
+    Position& pos;
+    const Search::RootMoves& rootMoves;
+    bool stop = false;
+  };
+
+
+  // Solver::expand() makes a child for each legal move, or for each rootMoves
+  // entry at the root. When the attacker has a single ply left only checks
+  // are worth trying. The children that end the line are solved at once, the
+  // others start with a defender's delta equal to its number of replies, so
+  // that the attacker first tries the moves which leave the fewest.
+
+  void Solver::expand(int ply, int pliesLeft, std::vector<Child>& children) {
+
+    bool attacker = !(ply & 1);
+    StateInfo st;
+
+    auto add = [&](Move m) {
+
+      bool givesCheck = pos.gives_check(m);
+
+      if (attacker && pliesLeft == 1 && !givesCheck)
+          return;
+
+      Child c = { m, 0, 1, 1, 0, false };
+
+      pos.do_move(m, st, givesCheck);
+      c.key = pos.key();
+
+      if (pos.is_draw(ply + 1))
+          c.solved = true, c.phi = attacker ? 0 : INF, c.delta = attacker ? INF : 0;
+
+      else if (attacker)
+      {
+          size_t replies = MoveList<LEGAL>(pos).size();
+
+          if (!replies && pos.checkers())
+              c.solved = true, c.phi = INF, c.delta = 0; // Mated
+
+          else if (!replies || pliesLeft == 1)
+              c.solved = true, c.phi = 0, c.delta = INF; // Stalemate or out of plies
+
+          else
+              c.delta = uint32_t(replies);
+      }
+
+      pos.undo_move(m);
+      children.push_back(c);
+    };
+
+    if (ply == 0)
+        for (const auto& rm : rootMoves)
+            add(rm.pv[0]);
+    else
+        for (const auto& m : MoveList<LEGAL>(pos))
+            add(m);
+  }
+
+
+  // Solver::mid() searches the node until its phi reaches thPhi or its delta
+  // reaches thDelta, and stores the result in the table.
+
+  void Solver::mid(int ply, int pliesLeft, uint32_t thPhi, uint32_t thDelta) {
+
+    uint64_t startNodes = nodes++;
+    Key key = pos.key();
+    std::vector<Child> children;
+    StateInfo st;
+    uint32_t phi, delta;
+    int length;
+
+    if ((nodes & 1023) == 0)
+        check_limits();
+
+    expand(ply, pliesLeft, children);
+
+    while (true)
+    {
+        // phi is the smallest delta of the children, delta the sum of the phi
+        uint64_t sum = 0;
+        uint32_t delta2 = INF;
+        Child* best = nullptr;
+        int wonLength = INT_MAX, lostLength = 0;
+
+        for (Child& c : children)
+        {
+            if (!c.solved)
+                if (const Entry* e = PNTable.probe(c.key, pliesLeft - 1))
+                    c.phi = e->phi, c.delta = e->delta, c.length = e->length;
+
+            if (!best || c.delta < best->delta)
+            {
+                if (best)
+                    delta2 = best->delta;
+                best = &c;
+            }
+            else
+                delta2 = std::min(delta2, c.delta);
+
+            sum = c.phi == INF || sum == INF ? INF : sum + c.phi;
+
+            if (c.delta == 0)
+                wonLength = std::min(wonLength, c.length + 1);
+            lostLength = std::max(lostLength, c.length + 1);
+        }
+
+        phi   = best ? best->delta : INF;
+        delta = uint32_t(sum == INF ? INF : std::min(sum, uint64_t(INF - 1)));
+        length = phi == 0 ? wonLength : lostLength;
+
+        if (phi >= thPhi || delta >= thDelta || stop)
+            break;
+
+        // The child thresholds keep the search in the child while it stays the
+        // most proving one and the node has not reached its own thresholds.
+        uint64_t cPhi = uint64_t(thDelta) - delta + best->phi;
+        uint32_t cDelta = std::min(thPhi, delta2 == INF ? INF : delta2 + 1);
+
+        pos.do_move(best->move, st);
+        mid(ply + 1, pliesLeft - 1, uint32_t(std::min(cPhi, uint64_t(INF))), cDelta);
+        pos.undo_move(best->move);
+    }
+
+    PNTable.store(key, pliesLeft, phi, delta,
+                  uint32_t(std::min(nodes - startNodes, uint64_t(UINT32_MAX))), length);
+  }
+
+
+  // Solver::check_limits() stops the search on a 'stop' command or when the
+  // node or movetime limit of the 'go' command is reached.
+
+  void Solver::check_limits() {
+
+    stop =   Threads.stop
+          || (Search::Limits.nodes && Threads.nodes_searched() >= uint64_t(Search::Limits.nodes))
+          || (Search::Limits.movetime && Time.elapsed() >= Search::Limits.movetime);
+  }
+
+
+  // Solver::extract_pv() follows a proof from the root: the attacker plays the
+  // shortest mate and the defender the longest resistance found in the table.
+
+  void Solver::extract_pv(int pliesLeft, std::vector<Move>& pv) {
+
+    StateInfo states[MAX_PLY];
+
+    for (int ply = 0; pliesLeft > 0; ++ply, --pliesLeft)
+    {
+        std::vector<Child> children;
+        expand(ply, pliesLeft, children);
+
+        Child* best = nullptr;
+        bool attacker = !(ply & 1);
+
+        for (Child& c : children)
+        {
+            if (!c.solved)
+                if (const Entry* e = PNTable.probe(c.key, pliesLeft - 1))
+                    c.phi = e->phi, c.delta = e->delta, c.length = e->length;
+
+            if (attacker ? c.delta != 0 : c.phi != 0)
+                continue;
+
+            if (   !best
+                || (attacker ? c.length < best->length : c.length > best->length))
+                best = &c;
+        }
+
+        if (!best)
+            break;
+
+        pv.push_back(best->move);
+        pos.do_move(best->move, states[ply]);
+    }
+
+    for (auto it = pv.rbegin(); it != pv.rend(); ++it)
+        pos.undo_move(*it);
+  }
+
+} // namespace
+
+
+/// Mate::solve() runs the df-pn solver for 'go mate N' on the root moves, for
+/// a mate in 1, 2 and so on up to N moves, so that the first proof is also the
+/// shortest mate. If it proves a mate it moves the mating move to the front of
+/// rootMoves, with its score and principal variation, and prints the search
+/// info. It returns false when it disproves the mate, so that the caller falls
+/// back to the regular search, and true when it is stopped.
+
+bool Mate::solve(Position& pos, Search::RootMoves& rootMoves, int mate) {
+
+  PNTable.new_solve(Options["Mate Hash"]);
+
+  Solver solver(pos, rootMoves);
+  const Entry* e = nullptr;
+  int pliesLeft = 1;
+
+  for (int m = 1; m <= mate && pliesLeft < MAX_PLY - 1; ++m)
+  {
+      pliesLeft = 2 * m - 1;
+      solver.mid(0, pliesLeft, INF, INF);
+      e = PNTable.probe(pos.key(), pliesLeft);
+
+      if (solver.aborted() || !e || e->phi == 0)
+          break;
+  }
+
+  bool proven = e && e->phi == 0 && !solver.aborted();
+
+  if (!proven)
+  {
+      sync_cout << "info string mate solver: "
+                << (e && e->delta == 0 ? "no mate in " + std::to_string(mate) : "stopped")
+                << " after " << Threads.nodes_searched() << " nodes " << Time.elapsed() << " ms"
+                << sync_endl;
+      return solver.aborted();
+  }
+
+  std::vector<Move> pv;
+  solver.extract_pv(pliesLeft, pv);
+
+  // A missing entry can cut the line short, but the first move is proven
+  if (pv.empty())
+      return false;
+
+  auto rm = std::find(rootMoves.begin(), rootMoves.end(), pv[0]);
+  std::rotate(rootMoves.begin(), rm, rm + 1);
+
+  rootMoves[0].score = mate_in(e->length);
+  rootMoves[0].selDepth = int(pv.size());
+  rootMoves[0].pv = pv;
+
+  sync_cout << UCI::pv(pos, pliesLeft, -VALUE_INFINITE, VALUE_INFINITE) << sync_endl;
+  sync_cout << "info string mate solver: mate in " << (e->length + 1) / 2
+            << " after " << Threads.nodes_searched() << " nodes " << Time.elapsed() << " ms"
+            << sync_endl;
+
+  return true;
+}
+
+
+/// Mate::clear() releases the memory of the solver's table, which the next
+/// solve allocates again. It is called on 'ucinewgame', 'Clear Hash' and when
+/// "Mate Hash" changes.
+
+void Mate::clear() {
+
+  Threads.main()->wait_for_search_finished();
+
+  PNTable.clear();
+}
@@ -64,8 +64,14 @@ struct Entry {
   Phase gamePhase;
 };
 
-typedef HashTable<Entry, 8192> Table;
+#if defined(USE_LEAN_TABLES)
+/// In lean builds each thread looks up the material entries in a small hash
+/// table of its own, instead of the direct table shared by all threads.
+constexpr int TableSize = 2048;
+typedef HashTable<Entry, TableSize> Table;
+#endif
 
+void init();
 Entry* probe(const Position& pos);
 
 } // namespace Material
@@ -0,0 +1,683 @@
+/*
+  Stockfish, a UCI chess playing engine derived from Glaurung 2.1
+  Copyright (C) 2004-2008 Tord Romstad (Glaurung author)
+  Copyright (C) 2008-2015 Marco Costalba, Joona Kiiski, Tord Romstad
+  Copyright (C) 2015-2020 Marco Costalba, Joona Kiiski, Gary Linscott, Tord Romstad
+
+  Stockfish is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  Stockfish is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+/// A harness timing the hot primitives of the engine in isolation. It is built
+/// with 'make microbench' into a separate executable, and runs each function
+/// over a fixed corpus: the bench positions plus every position one legal move
+/// away from them, which includes positions in check and after captures.
+///
+/// stockfish-microbench [SyzygyPath]
+
+#include <algorithm>
+#include <cassert>
+#include <chrono>
+#include <deque>
+#include <iomanip>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+#if defined(__x86_64__) || defined(__i386__)
+#  include <x86intrin.h> // For __rdtsc()
+#  define HAS_RDTSC
+#elif defined(_MSC_VER) && (defined(_M_X64) || defined(_M_IX86))
+#  include <intrin.h>
+#  define HAS_RDTSC
+#endif
+
+#if defined(USE_AVX512)
+#  include <immintrin.h>
+#endif
+
+#include "bitboard.h"
+#include "endgame.h"
+#include "evaluate.h"
+#include "material.h"
+#include "movegen.h"
+#include "movepick.h"
+#include "pawns.h"
+#include "position.h"
+#include "search.h"
+#include "thread.h"
+#include "tt.h"
+#include "uci.h"
+#include "syzygy/tbprobe.h"
+
+using namespace std;
+
+extern vector<string> setup_bench(const Position&, istream&);
+
+namespace PSQT {
+  void init();
+}
+
+namespace {
+
+typedef std::chrono::steady_clock Clock;
+
+constexpr double MinTime = 200; // Milliseconds per kernel
+
+// Corpus holds the positions, each with its own StateInfo, and their legal moves
+struct Corpus {
+  std::deque<StateInfo> states;
+  std::deque<Position> positions;
+  vector<vector<Move>> moves;
+  size_t moveCount = 0;
+
+  void add(const string& fen, bool isChess960) {
+
+    states.emplace_back();
+    positions.emplace_back();
+    positions.back().set(fen, isChess960, &states.back(), Threads.main());
+    moves.emplace_back();
+
+    for (const auto& m : MoveList<LEGAL>(positions.back()))
+        moves.back().push_back(m);
+
+    moveCount += moves.back().size();
+  }
+};
+
+Corpus corpus;
+
+
+// cycles() reads the time stamp counter, which counts reference cycles at a
+// constant rate. Returns 0 where it is not available.
+
+uint64_t cycles() {
+#ifdef HAS_RDTSC
+  return __rdtsc();
+#else
+  return 0;
+#endif
+}
+
+
+// build_corpus() fills the corpus from the default bench positions
+
+void build_corpus() {
+
+  Position pos;
+  StateInfo st;
+  istringstream is("16 1 1 default depth");
+  bool chess960 = false;
+
+  for (const string& cmd : setup_bench(pos, is))
+      if (cmd.find("setoption name UCI_Chess960") == 0)
+          chess960 = cmd.find("true") != string::npos;
+
+      else if (cmd.find("position fen ") == 0)
+      {
+          string fen = cmd.substr(13, cmd.find(" moves") - 13);
+
+          pos.set(fen, chess960, &st, Threads.main());
+          corpus.add(fen, chess960);
+
+          for (const auto& m : MoveList<LEGAL>(pos))
+          {
+              StateInfo st2;
+              pos.do_move(m, st2);
+              corpus.add(pos.fen(), chess960);
+              pos.undo_move(m);
+          }
+      }
+}
+
+
+// run() times a kernel, a function doing one pass over the corpus that returns
+// its number of operations, repeating it for at least MinTime milliseconds after
+// a warm-up pass. The checksum of the results keeps the work from being
+// optimized away.
+
+template<typename Kernel>
+void run(const string& name, Kernel kernel) {
+
+  uint64_t sink = 0, ops = 0;
+  double ms = 0;
+
+  if (!kernel(sink))
+  {
+      cout << left << setw(24) << name << "skipped, nothing to run on" << endl;
+      return;
+  }
+
+  Clock::time_point start = Clock::now();
+  uint64_t c = cycles();
+
+  while (ms < MinTime)
+  {
+      ops += kernel(sink);
+      ms = std::chrono::duration<double, std::milli>(Clock::now() - start).count();
+  }
+
+  c = cycles() - c;
+
+  cout << left  << setw(24) << name
+       << right << fixed << setprecision(2) << setw(10) << ms * 1e6 / ops << " ns/op"
+       << setprecision(1) << setw(10) << double(c) / ops << " cycles/op"
+       << setw(14) << ops << " ops  " << hex << (sink & 0xFFFF) << dec << endl;
+}
+
+
+template<PieceType Pt>
+uint64_t attacks_kernel(uint64_t& sink) {
+
+  for (const Position& pos : corpus.positions)
+      for (Square s = SQ_A1; s <= SQ_H8; ++s)
+          sink += Pt == QUEEN ? attacks_bb(QUEEN, s, pos.pieces())
+                              : attacks_bb<Pt>(s, pos.pieces());
+
+  return corpus.positions.size() * SQUARE_NB;
+}
+
+
+template<GenType T>
+uint64_t generate_kernel(uint64_t& sink) {
+
+  ExtMove moveList[MAX_MOVES];
+  uint64_t ops = 0;
+
+  for (const Position& pos : corpus.positions)
+      if (T == LEGAL || (T == EVASIONS) == bool(pos.checkers()))
+      {
+          sink += generate<T>(pos, moveList) - moveList;
+          ++ops;
+      }
+
+  return ops;
+}
+
+
+// For all the legal moves of the corpus
+template<typename F>
+uint64_t for_each_move(F f) {
+
+  for (size_t i = 0; i < corpus.positions.size(); ++i)
+      for (Move m : corpus.moves[i])
+          f(corpus.positions[i], m);
+
+  return corpus.moveCount;
+}
+
+
+// For the positions not in check, as needed by evaluate()
+template<typename F>
+uint64_t for_each_quiet_position(F f) {
+
+  uint64_t ops = 0;
+
+  for (Position& pos : corpus.positions)
+      if (!pos.checkers())
+          f(pos), ++ops;
+
+  return ops;
+}
+
+
+// Endgame lookup. Endgames::probe() is timed against the std::unordered_map
+// it replaced, on the material keys of every endgame with up to four pieces
+// besides the kings: 1M lookups of which 1 in 8 finds an endgame, as in
+// Material::init() where most material configurations have no endgame.
+
+vector<Key> endgameKeys;
+std::unordered_map<Key, const EndgameBase<Value>*> valueMap;
+std::unordered_map<Key, const EndgameBase<ScaleFactor>*> scaleMap;
+
+void build_endgame_keys() {
+
+  const string Pieces = "QRBNP";
+  vector<string> sides = { "" };
+  vector<Key> hitKeys, missKeys;
+
+  // All the sets of up to four pieces, strongest first as in "KRPKR"
+  for (size_t i = 0; i < sides.size(); ++i)
+      if (sides[i].size() < 4)
+          for (size_t p = sides[i].empty() ? 0 : Pieces.find(sides[i].back()); p < Pieces.size(); ++p)
+              sides.push_back(sides[i] + Pieces[p]);
+
+  for (const string& strong : sides)
+      for (const string& weak : sides)
+          if (strong.size() + weak.size() <= 4)
+              for (Color c : { WHITE, BLACK })
+              {
+                  StateInfo st;
+                  Key key = Position().set("K" + strong + "K" + weak, c, &st).material_key();
+                  const EndgameBase<Value>* v = Endgames::probe<Value>(key);
+                  const EndgameBase<ScaleFactor>* sf = Endgames::probe<ScaleFactor>(key);
+
+                  if (v)
+                      valueMap[key] = v;
+                  if (sf)
+                      scaleMap[key] = sf;
+
+                  (v || sf ? hitKeys : missKeys).push_back(key);
+              }
+
+  PRNG rng(1070372);
+
+  for (int i = 0; i < 1000000; ++i)
+  {
+      const vector<Key>& keys = i % 8 ? missKeys : hitKeys;
+      endgameKeys.push_back(keys[rng.rand<unsigned>() % keys.size()]);
+  }
+}
+
+
+// Quiet move ordering. MovePicker scores the quiets with a scalar loop and
+// orders them with partial_insertion_sort(). The candidates below give exactly
+// the same order, but have not been faster on the hardware at hand, so
+// MovePicker does not use them yet. They are timed on the quiet moves of the
+// corpus positions not in check, at depths 3 and 8, with random histories.
+
+struct QuietList {
+  const Position* pos;
+  ExtMove moves[MAX_MOVES];
+  int size;
+  Depth depth;
+};
+
+vector<QuietList> quietLists;
+ButterflyHistory* mainHistory;
+ContinuationHistory* contHistory;
+const PieceToHistory* contHist[6];
+
+
+// build_quiet_lists() fills the histories with random values and collects the
+// quiet moves
+
+void build_quiet_lists() {
+
+  mainHistory = new ButterflyHistory;
+  contHistory = new ContinuationHistory;
+  PRNG rng(1070372);
+
+  auto random = [&](int d) { return int16_t(int(rng.rand<unsigned>() % (2 * d + 1)) - d); };
+
+  for (auto& c : *mainHistory)
+      for (auto& e : c)
+          e = random(10692);
+
+  for (auto& pc : *contHistory)
+      for (auto& to : pc)
+      {
+          PieceToHistory* h = &to; // StatsEntry::operator&() gives the table
+          for (auto& pieceTo : *h)
+              for (auto& e : pieceTo)
+                  e = random(29952);
+      }
+
+  for (auto& ch : contHist)
+      ch = &(*contHistory)[rng.rand<unsigned>() % PIECE_NB][rng.rand<unsigned>() % SQUARE_NB];
+
+  for (const Position& pos : corpus.positions)
+      if (!pos.checkers())
+          for (Depth d : { 3, 8 })
+          {
+              quietLists.emplace_back();
+              QuietList& l = quietLists.back();
+              l.pos = &pos;
+              l.size = int(generate<QUIETS>(pos, l.moves) - l.moves);
+              l.depth = d;
+          }
+}
+
+
+// partition_quiets() moves the first move and the moves scoring at least
+// 'limit' to the front, keeping their relative order, and shuffles the other
+// moves exactly as partial_insertion_sort() does. It returns the end of the
+// front part, whose stable descending order is then produced by next_ordered()
+// only as far as the moves are actually tried, as most nodes cut off early.
+
+ExtMove* partition_quiets(ExtMove* begin, ExtMove* end, int limit) {
+
+  ExtMove* sortedEnd = begin;
+
+  for (ExtMove* p = begin + 1; p < end; ++p)
+      if (p->value >= limit)
+          std::swap(*p, *++sortedEnd);
+
+  return std::min(sortedEnd + 1, end);
+}
+
+
+// next_ordered() puts in place the move at cur of the front part [begin, end)
+// built by partition_quiets(). The first LazyPicks moves are picked one at a
+// time, bringing the first best move to cur and shifting the others up by
+// one so that ties keep the order of a stable sort. Past that the node is not
+// cutting off soon, and the rest is insertion sorted in one go. Returns the
+// new end of the part still to be ordered.
+
+constexpr int LazyPicks = 3;
+
+ExtMove* next_ordered(ExtMove* begin, ExtMove* cur, ExtMove* end) {
+
+  if (cur >= end)
+      return end;
+
+  if (cur - begin < LazyPicks)
+  {
+      ExtMove* best = std::max_element(cur, end);
+      std::rotate(cur, best, best + 1);
+      return end;
+  }
+
+  for (ExtMove* p = cur + 1; p < end; ++p)
+  {
+      ExtMove tmp = *p, *q;
+      for (q = p; q != cur && *(q - 1) < tmp; --q)
+          *q = *(q - 1);
+      *q = tmp;
+  }
+
+  return cur;
+}
+
+
+// score_quiets_scalar() is the scoring of MovePicker::score<QUIETS>()
+
+void score_quiets_scalar(ExtMove* begin, ExtMove* end, const Position& pos) {
+
+  for (ExtMove* m = begin; m < end; ++m)
+      m->value =      (*mainHistory)[pos.side_to_move()][from_to(*m)]
+                 + 2 * (*contHist[0])[pos.moved_piece(*m)][to_sq(*m)]
+                 + 2 * (*contHist[1])[pos.moved_piece(*m)][to_sq(*m)]
+                 + 2 * (*contHist[3])[pos.moved_piece(*m)][to_sq(*m)]
+                 +     (*contHist[5])[pos.moved_piece(*m)][to_sq(*m)];
+}
+
+#if defined(USE_AVX512)
+
+// gather_int16() loads table[idx] for the 16 lanes of idx selected by k. The
+// tables hold 16-bit entries, so we gather the aligned 32-bit word holding
+// each entry and sign extend its low or high half, never reading past the
+// end of the table.
+
+inline __m512i gather_int16(__mmask16 k, const int16_t* table, __m512i idx) {
+
+  assert(!(uintptr_t(table) & 3));
+
+  const __m512i One = _mm512_set1_epi32(1);
+
+  __m512i word  = _mm512_mask_i32gather_epi32(_mm512_setzero_si512(), k,
+                                              _mm512_maskz_andnot_epi32(0xFFFF, One, idx), table, 2);
+  __m512i shift = _mm512_maskz_slli_epi32(0xFFFF, _mm512_maskz_andnot_epi32(0xFFFF, idx, One), 4);
+
+  return _mm512_maskz_srai_epi32(0xFFFF, _mm512_maskz_sllv_epi32(0xFFFF, word, shift), 16);
+}
+
+
+// score_quiets() decodes all the moves first, then pulls the five history
+// values of 16 moves at a time with gathers and scatters the sums back
+// into the move list.
+
+void score_quiets(ExtMove* begin, ExtMove* end, const Position& pos) {
+
+  const int n = int(end - begin);
+  alignas(64) int32_t fromTo[MAX_MOVES], pieceTo[MAX_MOVES];
+
+  for (int i = 0; i < n; ++i)
+  {
+      fromTo[i]  = from_to(begin[i]);
+      pieceTo[i] = pos.moved_piece(begin[i]) * SQUARE_NB + to_sq(begin[i]);
+  }
+
+  auto table = [](const StatsEntry<int16_t, 29952>& e) {
+      return reinterpret_cast<const int16_t*>(&e);
+  };
+
+  const int16_t* mh = reinterpret_cast<const int16_t*>(&(*mainHistory)[pos.side_to_move()][0]);
+  const int16_t* c0 = table((*contHist[0])[0][0]);
+  const int16_t* c1 = table((*contHist[1])[0][0]);
+  const int16_t* c3 = table((*contHist[3])[0][0]);
+  const int16_t* c5 = table((*contHist[5])[0][0]);
+
+  // ExtMove is {move, value}: the values sit every other 32-bit word
+  const __m512i ValueOffsets = _mm512_set_epi32(31, 29, 27, 25, 23, 21, 19, 17,
+                                                15, 13, 11,  9,  7,  5,  3,  1);
+
+  for (int i = 0; i < n; i += 16)
+  {
+      __mmask16 k = n - i >= 16 ? 0xFFFF : __mmask16((1 << (n - i)) - 1);
+      __m512i ft = _mm512_maskz_loadu_epi32(k, fromTo + i);
+      __m512i pt = _mm512_maskz_loadu_epi32(k, pieceTo + i);
+
+      __m512i twice = _mm512_add_epi32(gather_int16(k, c0, pt),
+                      _mm512_add_epi32(gather_int16(k, c1, pt), gather_int16(k, c3, pt)));
+
+      __m512i v = _mm512_add_epi32(_mm512_add_epi32(gather_int16(k, mh, ft), gather_int16(k, c5, pt)),
+                                   _mm512_add_epi32(twice, twice));
+
+      _mm512_mask_i32scatter_epi32(reinterpret_cast<int*>(begin + i), k, ValueOffsets, v, 4);
+  }
+}
+
+#else
+
+inline void score_quiets(ExtMove* begin, ExtMove* end, const Position& pos) {
+  score_quiets_scalar(begin, end, pos);
+}
+
+#endif
+
+
+// order_quiets() scores and orders a quiet list into work, as MovePicker does
+// or with the candidates, as far as the first 'tried' moves are picked
+
+template<bool Candidates>
+void order_quiets(const QuietList& l, ExtMove* work, int tried) {
+
+  std::copy(l.moves, l.moves + l.size, work);
+
+  if (!Candidates)
+  {
+      score_quiets_scalar(work, work + l.size, *l.pos);
+      partial_insertion_sort(work, work + l.size, -3000 * l.depth);
+      return;
+  }
+
+  score_quiets(work, work + l.size, *l.pos);
+  ExtMove* endOrdered = partition_quiets(work, work + l.size, -3000 * l.depth);
+
+  for (ExtMove* c = work; c < work + std::min(tried, l.size); ++c)
+      endOrdered = next_ordered(work, c, endOrdered);
+}
+
+
+// same_quiet_order() checks that the candidates give MovePicker's order
+bool same_quiet_order() {
+
+  ExtMove work[MAX_MOVES], reference[MAX_MOVES];
+
+  for (const QuietList& l : quietLists)
+  {
+      order_quiets<false>(l, reference, MAX_MOVES);
+      order_quiets<true>(l, work, MAX_MOVES);
+
+      for (int j = 0; j < l.size; ++j)
+          if (work[j].move != reference[j].move || work[j].value != reference[j].value)
+              return false;
+  }
+
+  return true;
+}
+
+
+template<bool Candidates, int Tried>
+uint64_t order_kernel(uint64_t& sink) {
+
+  ExtMove work[MAX_MOVES];
+
+  for (const QuietList& l : quietLists)
+  {
+      order_quiets<Candidates>(l, work, Tried);
+
+      for (int j = 0; j < std::min(Tried, l.size); ++j)
+          sink += work[j].move;
+  }
+
+  return uint64_t(quietLists.size());
+}
+
+} // namespace
+
+
+int main(int argc, char* argv[]) {
+
+  cout << engine_info() << endl;
+
+  UCI::init(Options);
+  PSQT::init();
+  Bitboards::init();
+  Bitbases::init(std::max(std::thread::hardware_concurrency(), 1U));
+  Bitbases::wait();
+  Position::init();
+  Endgames::init();
+  Material::init();
+  Threads.set(1);
+
+  if (argc > 1)
+      Tablebases::init(argv[1]);
+
+  build_corpus();
+
+  cout << "Corpus: " << corpus.positions.size() << " positions, "
+       << corpus.moveCount << " legal moves\n" << endl;
+
+  run("attacks_bb<ROOK>",   attacks_kernel<ROOK>);
+  run("attacks_bb<BISHOP>", attacks_kernel<BISHOP>);
+  run("attacks_bb<QUEEN>",  attacks_kernel<QUEEN>);
+
+  run("generate<CAPTURES>",     generate_kernel<CAPTURES>);
+  run("generate<QUIETS>",       generate_kernel<QUIETS>);
+  run("generate<QUIET_CHECKS>", generate_kernel<QUIET_CHECKS>);
+  run("generate<EVASIONS>",     generate_kernel<EVASIONS>);
+  run("generate<NON_EVASIONS>", generate_kernel<NON_EVASIONS>);
+  run("generate<LEGAL>",        generate_kernel<LEGAL>);
+
+  run("do_move + undo_move", [](uint64_t& sink) {
+      return for_each_move([&](Position& pos, Move m) {
+          StateInfo st;
+          pos.do_move(m, st);
+          sink += pos.key();
+          pos.undo_move(m);
+      });
+  });
+
+  run("see_ge", [](uint64_t& sink) {
+      return for_each_move([&](Position& pos, Move m) { sink += pos.see_ge(m); });
+  });
+
+  run("gives_check", [](uint64_t& sink) {
+      return for_each_move([&](Position& pos, Move m) { sink += pos.gives_check(m); });
+  });
+
+  run("Eval::evaluate", [](uint64_t& sink) {
+      return for_each_quiet_position([&](Position& pos) { sink += Eval::evaluate(pos); });
+  });
+
+  run("Pawns::probe", [](uint64_t& sink) {
+      return for_each_quiet_position([&](Position& pos) { sink += uintptr_t(Pawns::probe(pos)); });
+  });
+
+  run("Material::probe", [](uint64_t& sink) {
+      return for_each_quiet_position([&](Position& pos) { sink += uintptr_t(Material::probe(pos)); });
+  });
+
+  run("TT.probe", [](uint64_t& sink) {
+      return for_each_quiet_position([&](Position& pos) {
+          bool found;
+          sink += uintptr_t(TT.probe(pos.key(), found)) + found;
+      });
+  });
+
+  build_endgame_keys();
+
+  run("Endgames::probe", [](uint64_t& sink) {
+      for (Key key : endgameKeys)
+          sink += uintptr_t(Endgames::probe<Value>(key)) + uintptr_t(Endgames::probe<ScaleFactor>(key));
+      return uint64_t(endgameKeys.size());
+  });
+
+  run("unordered_map::find", [](uint64_t& sink) {
+      for (Key key : endgameKeys)
+      {
+          auto v = valueMap.find(key);
+          auto sf = scaleMap.find(key);
+          sink +=  uintptr_t(v  != valueMap.end() ? v->second  : nullptr)
+                 + uintptr_t(sf != scaleMap.end() ? sf->second : nullptr);
+      }
+      return uint64_t(endgameKeys.size());
+  });
+
+  build_quiet_lists();
+
+  cout << "Quiet lists: " << quietLists.size() << ", candidates give the same order: "
+       << (same_quiet_order() ? "yes" : "NO") << endl;
+
+  run("score quiets", [](uint64_t& sink) {
+      ExtMove work[MAX_MOVES];
+      for (const QuietList& l : quietLists)
+      {
+          std::copy(l.moves, l.moves + l.size, work);
+          score_quiets_scalar(work, work + l.size, *l.pos);
+          sink += work[0].value;
+      }
+      return uint64_t(quietLists.size());
+  });
+
+  if (HasAvx512)
+      run("score quiets, gathers", [](uint64_t& sink) {
+          ExtMove work[MAX_MOVES];
+          for (const QuietList& l : quietLists)
+          {
+              std::copy(l.moves, l.moves + l.size, work);
+              score_quiets(work, work + l.size, *l.pos);
+              sink += work[0].value;
+          }
+          return uint64_t(quietLists.size());
+      });
+
+  run("sort quiets, all",     order_kernel<false, MAX_MOVES>);
+  run("lazy quiets, all",     order_kernel<true,  MAX_MOVES>);
+  run("sort quiets, first 3", order_kernel<false, 3>);
+  run("lazy quiets, first 3", order_kernel<true,  3>);
+
+  if (!Tablebases::MaxCardinality)
+      cout << left << setw(24) << "Tablebases::probe_wdl" << "skipped, give a SyzygyPath argument" << endl;
+  else
+      run("Tablebases::probe_wdl", [](uint64_t& sink) {
+          uint64_t ops = 0;
+          for (Position& pos : corpus.positions)
+              if (   popcount(pos.pieces()) <= Tablebases::MaxCardinality
+                  && !pos.can_castle(ANY_CASTLING))
+              {
+                  Tablebases::ProbeState err;
+                  sink += Tablebases::probe_wdl(pos, &err);
+                  ++ops;
+              }
+          return ops;
+      });
+
+  Threads.set(0);
+  return 0;
+}
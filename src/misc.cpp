@@ -41,10 +41,17 @@ typedef bool(*fun3_t)(HANDLE, CONST GROUP_AFFINITY*, PGROUP_AFFINITY);
 }
 #endif
 
+#include <algorithm>
+#include <condition_variable>
+#include <cstdlib>
+#include <cstring>
 #include <fstream>
 #include <iomanip>
 #include <iostream>
+#include <memory>
+#include <mutex>
 #include <sstream>
+#include <thread>
 #include <vector>
 
 #include "misc.h"
@@ -241,6 +248,204 @@ void dbg_print() {
 }
 
 
+/// Dbg::register_thread() allocates the probe slots of the calling thread on
+/// its first probe. The slots are kept after the thread exits, so the counts
+/// of a resized thread pool still show up in the report until Dbg::clear().
+
+namespace Dbg {
+
+#ifdef USE_STATS
+
+std::atomic<const char*> Names[SLOT_NB];
+thread_local Slots* ThreadSlots;
+
+namespace {
+
+  std::mutex slotsMutex;
+  vector<unique_ptr<Slots>> allSlots;
+}
+
+Slots* register_thread() {
+
+  std::unique_lock<std::mutex> lk(slotsMutex);
+
+  allSlots.emplace_back(new Slots());
+  return allSlots.back().get();
+}
+
+#endif
+
+
+/// Dbg::report() sums the probe slots of all the threads, the debug 'dbgstats'
+/// command. For a timer it shows the rdtsc cycles, or nanoseconds on targets
+/// without a time stamp counter.
+
+const string report() {
+
+#ifndef USE_STATS
+  return "Debug probes are not collected, build with 'make build stats=yes'";
+#else
+  std::unique_lock<std::mutex> lk(slotsMutex);
+  stringstream ss;
+
+  for (int idx = 0; idx < SLOT_NB; ++idx)
+  {
+      if (!Names[idx])
+          continue;
+
+      int64_t count = 0, buckets[BUCKET_NB] = {}, samples = 0;
+      uint64_t calls = 0, cycles = 0;
+      int threads = 0;
+
+      for (auto& s : allSlots)
+      {
+          bool used = s->count[idx] || s->calls[idx];
+
+          count += s->count[idx];
+          calls += s->calls[idx];
+          cycles += s->cycles[idx];
+
+          for (int b = 0; b < BUCKET_NB; ++b)
+          {
+              used |= s->histogram[idx][b] != 0;
+              buckets[b] += s->histogram[idx][b];
+              samples += s->histogram[idx][b];
+          }
+
+          threads += used;
+      }
+
+      if (!threads)
+          continue;
+
+      ss << setw(2) << idx << " " << Names[idx] << " (" << threads << " threads)\n";
+
+      if (count)
+          ss << "   count  " << count << "\n";
+
+      if (calls)
+          ss << "   timer  " << calls << " calls, " << cycles << " cycles, "
+             << fixed << setprecision(1) << double(cycles) / calls << " per call\n";
+
+      for (int b = 0; b < BUCKET_NB; ++b)
+          if (buckets[b])
+          {
+              int64_t lo = int64_t(1) << (b - !!b), hi = (int64_t(1) << b) - 1;
+              string range =  b == 0             ? "<= 0"
+                            : b == 1             ? "1"
+                            : b == BUCKET_NB - 1 ? ">= " + to_string(lo)
+                                                 : to_string(lo) + "-" + to_string(hi);
+
+              ss << "   " << setw(24) << range << setw(14) << buckets[b]
+                 << setw(7) << fixed << setprecision(1)
+                 << 100.0 * buckets[b] / samples << "%\n";
+          }
+  }
+
+  return ss.str().empty() ? "No debug probes were hit" : ss.str();
+#endif
+}
+
+
+/// Dbg::clear() resets the probe slots of all the threads. Not to be called
+/// during a search.
+
+void clear() {
+
+#ifdef USE_STATS
+  std::unique_lock<std::mutex> lk(slotsMutex);
+
+  for (auto& s : allSlots)
+      std::memset(s.get(), 0, sizeof(Slots));
+#endif
+}
+
+} // namespace Dbg
+
+
+/// startup_step() records the time elapsed since the previous step, or since
+/// the program start for the first one, under the given step name. It is used
+/// in main() to time the initialization steps, reported by the 'startup' command.
+
+namespace {
+
+  typedef std::chrono::steady_clock Clock;
+
+  Clock::time_point LastStep = Clock::now();
+  vector<pair<string, double>> StartupSteps;
+}
+
+void startup_step(const std::string& name) {
+
+  Clock::time_point t = Clock::now();
+
+  StartupSteps.emplace_back(name, std::chrono::duration<double, std::milli>(t - LastStep).count());
+  LastStep = t;
+}
+
+const std::string startup_report() {
+
+  stringstream ss;
+  double total = 0;
+
+  ss << fixed << setprecision(3);
+
+  for (const auto& step : StartupSteps)
+  {
+      ss << left << setw(20) << step.first << right << setw(10) << step.second << " ms\n";
+      total += step.second;
+  }
+
+  ss << left << setw(20) << "Total" << right << setw(10) << total << " ms";
+
+  return ss.str();
+}
+
+
+/// memory_footprint() records the size in bytes of a table under the given name.
+/// A new record replaces any previous one with the same name, so that tables
+/// which are resized stay up to date. Tables are listed by the 'footprint' command.
+
+namespace {
+
+  vector<pair<string, size_t>> Footprints;
+}
+
+void memory_footprint(const std::string& name, size_t bytes) {
+
+  for (auto& fp : Footprints)
+      if (fp.first == name)
+      {
+          fp.second = bytes;
+          return;
+      }
+
+  Footprints.emplace_back(name, bytes);
+}
+
+const std::string footprint_report() {
+
+  vector<pair<string, size_t>> tables = Footprints;
+  stringstream ss;
+  size_t total = 0;
+
+  std::stable_sort(tables.begin(), tables.end(), [](const pair<string, size_t>& a,
+                                                    const pair<string, size_t>& b) {
+      return a.second > b.second;
+  });
+
+  for (const auto& fp : tables)
+  {
+      ss << left << setw(24) << fp.first << right << setw(12) << fp.second << " bytes\n";
+      total += fp.second;
+  }
+
+  ss << left << setw(24) << "Total" << right << setw(12) << total << " bytes";
+
+  return ss.str();
+}
+
+
 /// Used to serialize access to std::cout to avoid multiple threads writing at
 /// the same time.
 
@@ -258,6 +463,132 @@ std::ostream& operator<<(std::ostream& os, SyncCout sc) {
 }
 
 
+namespace {
+
+/// AsyncBuf collects the characters written to std::cout and, on each flush,
+/// pushes them as a Line to a lock-free list. The writer thread takes the whole
+/// list at once and writes it to the console in order, so producers never wait
+/// for the pipe: they only take the wake mutex when the writer is asleep.
+
+struct Line {
+  string text;
+  Line* next;
+};
+
+struct AsyncBuf : public streambuf {
+
+  int overflow(int c) override { pending += char(c); return c; }
+  streamsize xsputn(const char* s, streamsize n) override { pending.append(s, size_t(n)); return n; }
+  int sync() override;
+
+  void write_loop();
+
+  string pending;
+  streambuf* console = nullptr;
+  atomic<Line*> head;
+  atomic_bool waiting, done;
+  mutex wakeMutex;
+  condition_variable wakeCv;
+  std::thread writer;
+};
+
+AsyncBuf Async;
+
+int AsyncBuf::sync() {
+
+  if (pending.empty())
+      return 0;
+
+  Line* line = new Line{ std::move(pending), head.load() };
+  pending.clear();
+
+  while (!head.compare_exchange_weak(line->next, line)) {}
+
+  if (waiting)
+  {
+      std::lock_guard<mutex> lk(wakeMutex);
+      wakeCv.notify_one();
+  }
+
+  return 0;
+}
+
+void AsyncBuf::write_loop() {
+
+  while (true)
+  {
+      Line* list = head.exchange(nullptr);
+
+      if (!list)
+      {
+          if (done)
+              break;
+
+          unique_lock<mutex> lk(wakeMutex);
+          waiting = true;
+          wakeCv.wait(lk, [&]{ return head.load() || done; });
+          waiting = false;
+          continue;
+      }
+
+      // The list is newest first
+      Line* prev = nullptr;
+      while (list)
+          std::swap(list->next, prev), std::swap(list, prev);
+
+      for (Line* l = prev; l; l = prev)
+      {
+          console->sputn(l->text.data(), streamsize(l->text.size()));
+          prev = l->next;
+          delete l;
+      }
+
+      console->pubsync();
+  }
+}
+
+} // namespace
+
+namespace Output {
+
+void start() {
+
+  if (Async.console)
+      return;
+
+  Async.head = nullptr;
+  Async.waiting = Async.done = false;
+  Async.console = cout.rdbuf(&Async);
+  Async.writer = std::thread(&AsyncBuf::write_loop, &Async);
+
+  static bool once = !atexit(stop);
+  (void)once;
+}
+
+void stop() {
+
+  if (!Async.console)
+      return;
+
+  cout.flush();
+
+  {
+      std::lock_guard<mutex> lk(Async.wakeMutex);
+      Async.done = true;
+      Async.wakeCv.notify_one();
+  }
+
+  Async.writer.join();
+
+  if (cout.rdbuf() == &Async)
+      cout.rdbuf(Async.console);
+
+  Async.console = nullptr;
+}
+
+} // namespace Output
+
+
 /// Trampoline helper to avoid moving Logger to misc.h
 void start_logger(const std::string& fname) { Logger::start(fname); }
 
@@ -21,6 +21,7 @@
 #ifndef MISC_H_INCLUDED
 #define MISC_H_INCLUDED
 
+#include <atomic>
 #include <cassert>
 #include <chrono>
 #include <ostream>
@@ -29,6 +30,10 @@
 
 #include "types.h"
 
+#if defined(USE_STATS) && defined(_MSC_VER)
+#include <intrin.h> // For __rdtsc()
+#endif
+
 const std::string engine_info(bool to_uci = false);
 const std::string compiler_info();
 void prefetch(void* addr);
@@ -38,6 +43,10 @@ void dbg_hit_on(bool b);
 void dbg_hit_on(bool c, bool b);
 void dbg_mean_of(int v);
 void dbg_print();
+void startup_step(const std::string& name);
+const std::string startup_report();
+void memory_footprint(const std::string& name, size_t bytes);
+const std::string footprint_report();
 
 typedef std::chrono::milliseconds::rep TimePoint; // A value in milliseconds
 
@@ -64,6 +73,104 @@ std::ostream& operator<<(std::ostream&, SyncCout);
 #define sync_endl std::endl << IO_UNLOCK
 
 
+/// Output::start() hands what is written to std::cout over to a writer thread,
+/// so that a slow GUI pipe never blocks a search thread. Output::stop() writes
+/// the pending lines and goes back to direct output, it also runs at exit.
+
+namespace Output {
+  void start();
+  void stop();
+}
+
+
+/// Instrumentation of hot paths, collected only in builds with USE_STATS and
+/// compiled to nothing otherwise. A probe is identified by a slot index and a
+/// name, e.g. Dbg::count(0, "qsearch nodes"), Dbg::histogram(1, "moves", n) or
+/// Dbg::Timer t(2, "evaluate") for the rest of a block. Every thread writes to
+/// its own slots, so probes neither race nor share cache lines, and the 'dbgstats'
+/// command sums them over the threads.
+
+namespace Dbg {
+
+constexpr int SLOT_NB = 32;
+constexpr int BUCKET_NB = 32; // Bucket b > 0 counts values in [2^(b-1), 2^b)
+
+const std::string report();
+void clear();
+
+#ifdef USE_STATS
+
+struct Slots {
+  int64_t count[SLOT_NB];
+  int64_t histogram[SLOT_NB][BUCKET_NB];
+  uint64_t calls[SLOT_NB], cycles[SLOT_NB];
+};
+
+extern std::atomic<const char*> Names[SLOT_NB];
+extern thread_local Slots* ThreadSlots;
+Slots* register_thread();
+
+inline Slots& slots(int idx, const char* name) {
+
+  assert(0 <= idx && idx < SLOT_NB);
+
+  if (!Names[idx].load(std::memory_order_relaxed))
+      Names[idx] = name;
+
+  return ThreadSlots ? *ThreadSlots : *(ThreadSlots = register_thread());
+}
+
+inline uint64_t timestamp() {
+#if defined(__x86_64__) || defined(__i386__)
+  return __builtin_ia32_rdtsc();
+#elif defined(_MSC_VER) && (defined(_M_X64) || defined(_M_IX86))
+  return __rdtsc();
+#else
+  return std::chrono::duration_cast<std::chrono::nanoseconds>
+        (std::chrono::steady_clock::now().time_since_epoch()).count();
+#endif
+}
+
+inline void count(int idx, const char* name, int64_t n = 1) {
+  slots(idx, name).count[idx] += n;
+}
+
+inline void histogram(int idx, const char* name, int64_t v) {
+
+  int b = 0;
+  while (v > 0 && b < BUCKET_NB - 1)
+      v >>= 1, ++b;
+
+  ++slots(idx, name).histogram[idx][b];
+}
+
+class Timer {
+  int idx;
+  uint64_t start;
+
+public:
+  Timer(int i, const char* name) : idx(i) { slots(idx, name); start = timestamp(); }
+  ~Timer() {
+    uint64_t elapsed = timestamp() - start;
+    Slots& s = *ThreadSlots;
+    ++s.calls[idx], s.cycles[idx] += elapsed;
+  }
+};
+
+#else
+
+inline void count(int, const char*, int64_t = 1) {}
+inline void histogram(int, const char*, int64_t) {}
+
+struct Timer {
+  Timer(int, const char*) {}
+};
+
+#endif
+
+} // namespace Dbg
+
+
 /// xorshift64star Pseudo-Random Number Generator
 /// This class is based on original code written and dedicated
 /// to the public domain by Sebastiano Vigna (2014).
@@ -93,11 +200,6 @@ public:
   PRNG(uint64_t seed) : s(seed) { assert(seed); }
 
   template<typename T> T rand() { return T(rand64()); }
-
-  /// Special generator used to fast init magic numbers.
-  /// Output values only have 1/8th of their bits set on average.
-  template<typename T> T sparse_rand()
-  { return T(rand64() & rand64() & rand64()); }
 };
 
 
@@ -19,12 +19,71 @@
 */
 
 #include <cassert>
+#include <cstddef>
+
+#if defined(USE_AVX512)
+#include <immintrin.h>
+#endif
 
 #include "movegen.h"
 #include "position.h"
 
 namespace {
 
+#if defined(USE_AVX512)
+  // serialize() writes each move and its zero value with a single 64-bit store
+  static_assert(sizeof(ExtMove) == 8, "ExtMove must fill exactly one 64-bit lane");
+  static_assert(   offsetof(ExtMove, move) == 0
+                && offsetof(ExtMove, value) == 4, "ExtMove fields must be move, then value");
+#endif
+
+  // serialize() adds a move to each square of 'targets'. With D == 0 all the
+  // moves start from 'from', otherwise the origin is 'to - D' as for pawns.
+  // The moves are written in ascending order of destination square, exactly
+  // as a pop_lsb() loop would do, so both paths give the same move list.
+
+  template<Direction D>
+  ExtMove* serialize(ExtMove* moveList, Bitboard targets, Square from = SQ_A1) {
+
+#if defined(USE_AVX512)
+    // Compress the indices of the set bits into the low bytes of a vector,
+    // then widen them eight at a time to 64-bit ExtMove slots. The masked
+    // store never writes past the last move.
+    const __m512i Squares = _mm512_set_epi64(0x3F3E3D3C3B3A3938, 0x3736353433323130,
+                                             0x2F2E2D2C2B2A2928, 0x2726252423222120,
+                                             0x1F1E1D1C1B1A1918, 0x1716151413121110,
+                                             0x0F0E0D0C0B0A0908, 0x0706050403020100);
+    const __m512i Rotate  = _mm512_set_epi64(0, 7, 6, 5, 4, 3, 2, 1);
+    const __m512i origin  = _mm512_set1_epi64(D != 0 ? -64 * int(D) : 64 * int(from));
+
+    __m512i to = _mm512_maskz_compress_epi8(targets, Squares);
+    int n = popcount(targets);
+
+    // The maskz forms avoid spurious uninitialized warnings from some compilers
+    for ( ; n > 0; n -= 8, moveList += 8, to = _mm512_maskz_permutexvar_epi64(0xFF, Rotate, to))
+    {
+        __m512i t = _mm512_maskz_cvtepu8_epi64(0xFF, _mm512_maskz_extracti32x4_epi32(0xF, to, 0));
+
+        if (D != 0)
+            t = _mm512_add_epi64(t, _mm512_maskz_slli_epi64(0xFF, t, 6));
+
+        _mm512_mask_storeu_epi64(moveList, __mmask8(0xFF >> std::max(8 - n, 0)),
+                                 _mm512_add_epi64(origin, t));
+    }
+
+    return moveList + n; // n is now minus the unused slots of the last store
+#else
+    while (targets)
+    {
+        Square to = pop_lsb(&targets);
+        *moveList++ = make_move(D != 0 ? to - D : from, to);
+    }
+
+    return moveList;
+#endif
+  }
+
+
   template<GenType Type, Direction D>
   ExtMove* make_promotions(ExtMove* moveList, Square to, Square ksq) {
 
@@ -66,6 +125,26 @@ namespace {
     Bitboard pawnsOn7    = pos.pieces(Us, PAWN) &  TRank7BB;
     Bitboard pawnsNotOn7 = pos.pieces(Us, PAWN) & ~TRank7BB;
 
+    // Pawns pinned to our king may only move along the pin ray, so remove each
+    // of them from the sets of pawns allowed to step in the other directions.
+    // Filtering the sources keeps the order of the generated moves unchanged.
+    Bitboard upPawns = pos.pieces(Us, PAWN), rightPawns = upPawns, leftPawns = upPawns;
+    Bitboard pinned = pos.blockers_for_king(Us) & upPawns;
+
+    while (pinned)
+    {
+        Square s = pop_lsb(&pinned);
+        Bitboard pinRay = line_bb(pos.square<KING>(Us), s);
+
+        // Shift rather than add to the square, which may leave the board
+        if (!(shift<Up>(square_bb(s)) & pinRay))
+            upPawns ^= s;
+        if (!(shift<UpRight>(square_bb(s)) & pinRay))
+            rightPawns ^= s;
+        if (!(shift<UpLeft>(square_bb(s)) & pinRay))
+            leftPawns ^= s;
+    }
+
     Bitboard enemies = (Type == EVASIONS ? pos.pieces(Them) & target:
                         Type == CAPTURES ? target : pos.pieces(Them));
 
@@ -74,8 +153,8 @@ namespace {
     {
         emptySquares = (Type == QUIETS || Type == QUIET_CHECKS ? target : ~pos.pieces());
 
-        Bitboard b1 = shift<Up>(pawnsNotOn7)   & emptySquares;
-        Bitboard b2 = shift<Up>(b1 & TRank3BB) & emptySquares;
+        Bitboard b1 = shift<Up>(pawnsNotOn7 & upPawns) & emptySquares;
+        Bitboard b2 = shift<Up>(b1 & TRank3BB)       & emptySquares;
 
         if (Type == EVASIONS) // Consider only blocking squares
         {
@@ -92,7 +171,7 @@ namespace {
             // if the pawn is not on the same file as the enemy king, because we
             // don't generate captures. Note that a possible discovery check
             // promotion has been already generated amongst the captures.
-            Bitboard dcCandidateQuiets = pos.blockers_for_king(Them) & pawnsNotOn7;
+            Bitboard dcCandidateQuiets = pos.blockers_for_king(Them) & pawnsNotOn7 & upPawns;
             if (dcCandidateQuiets)
             {
                 Bitboard dc1 = shift<Up>(dcCandidateQuiets) & emptySquares & ~file_bb(ksq);
@@ -103,17 +182,8 @@ namespace {
             }
         }
 
-        while (b1)
-        {
-            Square to = pop_lsb(&b1);
-            *moveList++ = make_move(to - Up, to);
-        }
-
-        while (b2)
-        {
-            Square to = pop_lsb(&b2);
-            *moveList++ = make_move(to - Up - Up, to);
-        }
+        moveList = serialize<Up     >(moveList, b1);
+        moveList = serialize<Up + Up>(moveList, b2);
     }
 
     // Promotions and underpromotions
@@ -125,9 +195,9 @@ namespace {
         if (Type == EVASIONS)
             emptySquares &= target;
 
-        Bitboard b1 = shift<UpRight>(pawnsOn7) & enemies;
-        Bitboard b2 = shift<UpLeft >(pawnsOn7) & enemies;
-        Bitboard b3 = shift<Up     >(pawnsOn7) & emptySquares;
+        Bitboard b1 = shift<UpRight>(pawnsOn7 & rightPawns) & enemies;
+        Bitboard b2 = shift<UpLeft >(pawnsOn7 & leftPawns ) & enemies;
+        Bitboard b3 = shift<Up     >(pawnsOn7 & upPawns   ) & emptySquares;
 
         while (b1)
             moveList = make_promotions<Type, UpRight>(moveList, pop_lsb(&b1), ksq);
@@ -142,20 +212,11 @@ namespace {
     // Standard and en-passant captures
     if (Type == CAPTURES || Type == EVASIONS || Type == NON_EVASIONS)
     {
-        Bitboard b1 = shift<UpRight>(pawnsNotOn7) & enemies;
-        Bitboard b2 = shift<UpLeft >(pawnsNotOn7) & enemies;
+        Bitboard b1 = shift<UpRight>(pawnsNotOn7 & rightPawns) & enemies;
+        Bitboard b2 = shift<UpLeft >(pawnsNotOn7 & leftPawns ) & enemies;
 
-        while (b1)
-        {
-            Square to = pop_lsb(&b1);
-            *moveList++ = make_move(to - UpRight, to);
-        }
-
-        while (b2)
-        {
-            Square to = pop_lsb(&b2);
-            *moveList++ = make_move(to - UpLeft, to);
-        }
+        moveList = serialize<UpRight>(moveList, b1);
+        moveList = serialize<UpLeft >(moveList, b2);
 
         if (pos.ep_square() != SQ_NONE)
         {
@@ -171,8 +232,14 @@ namespace {
 
             assert(b1);
 
+            // En passant can uncover a check along the rank of the two pawns,
+            // which no pin ray describes, so here we ask Position::legal().
             while (b1)
-                *moveList++ = make<ENPASSANT>(pop_lsb(&b1), pos.ep_square());
+            {
+                Move m = make<ENPASSANT>(pop_lsb(&b1), pos.ep_square());
+                if (pos.legal(m))
+                    *moveList++ = m;
+            }
         }
     }
 
@@ -187,6 +254,8 @@ namespace {
     static_assert(Pt != KING && Pt != PAWN, "Unsupported piece type in generate_moves()");
 
     const Square* pl = pos.squares<Pt>(us);
+    const Square ksq = pos.square<KING>(us);
+    const Bitboard pinned = pos.blockers_for_king(us) & pos.pieces(us);
 
     for (Square from = *pl; from != SQ_NONE; from = *++pl)
     {
@@ -205,14 +274,37 @@ namespace {
         if (Checks)
             b &= pos.check_squares(Pt);
 
-        while (b)
-            *moveList++ = make_move(from, pop_lsb(&b));
+        // A pinned piece can only move along the line through our king
+        if (pinned & from)
+            b &= line_bb(ksq, from);
+
+        moveList = serialize<Direction(0)>(moveList, b, from);
     }
 
     return moveList;
   }
 
 
+  // generate_king_moves() adds the king moves to the destinations in b which
+  // are not attacked once the king has left its square, so that sliders keep
+  // attacking through it.
+
+  ExtMove* generate_king_moves(const Position& pos, ExtMove* moveList, Color us, Bitboard b) {
+
+    const Square ksq = pos.square<KING>(us);
+    const Bitboard occupied = pos.pieces() ^ ksq;
+
+    for (Bitboard t = b; t; )
+    {
+        Square to = pop_lsb(&t);
+        if (pos.attackers_to(to, occupied) & pos.pieces(~us))
+            b ^= to;
+    }
+
+    return serialize<Direction(0)>(moveList, b, ksq);
+  }
+
+
   template<Color Us, GenType Type>
   ExtMove* generate_all(const Position& pos, ExtMove* moveList, Bitboard target) {
 
@@ -229,17 +321,21 @@ namespace {
     if (Type != QUIET_CHECKS && Type != EVASIONS)
     {
         Square ksq = pos.square<KING>(Us);
-        Bitboard b = pos.attacks_from<KING>(ksq) & target;
-        while (b)
-            *moveList++ = make_move(ksq, pop_lsb(&b));
+        moveList = generate_king_moves(pos, moveList, Us, pos.attacks_from<KING>(ksq) & target);
 
+        // Castling through or out of attacked squares is rejected by
+        // Position::legal(), which also handles the Chess960 rook pins.
         if (Type != CAPTURES && pos.can_castle(CastlingRights(OO | OOO)))
         {
-            if (!pos.castling_impeded(OO) && pos.can_castle(OO))
-                *moveList++ = make<CASTLING>(ksq, pos.castling_rook_square(OO));
+            Move m;
+
+            if (   !pos.castling_impeded(OO) && pos.can_castle(OO)
+                &&  pos.legal(m = make<CASTLING>(ksq, pos.castling_rook_square(OO))))
+                *moveList++ = m;
 
-            if (!pos.castling_impeded(OOO) && pos.can_castle(OOO))
-                *moveList++ = make<CASTLING>(ksq, pos.castling_rook_square(OOO));
+            if (   !pos.castling_impeded(OOO) && pos.can_castle(OOO)
+                &&  pos.legal(m = make<CASTLING>(ksq, pos.castling_rook_square(OOO))))
+                *moveList++ = m;
         }
     }
 
@@ -249,11 +345,13 @@ namespace {
 } // namespace
 
 
-/// <CAPTURES>     Generates all pseudo-legal captures and queen promotions
-/// <QUIETS>       Generates all pseudo-legal non-captures and underpromotions
-/// <NON_EVASIONS> Generates all pseudo-legal captures and non-captures
+/// <CAPTURES>     Generates all legal captures and queen promotions
+/// <QUIETS>       Generates all legal non-captures and underpromotions
+/// <NON_EVASIONS> Generates all legal captures and non-captures
 ///
-/// Returns a pointer to the end of the move list.
+/// Pins are resolved with the pin rays through our king and king moves with
+/// the attackers of the destination square, so no move needs a later call to
+/// Position::legal(). Returns a pointer to the end of the move list.
 
 template<GenType Type>
 ExtMove* generate(const Position& pos, ExtMove* moveList) {
@@ -277,7 +375,7 @@ template ExtMove* generate<QUIETS>(const Position&, ExtMove*);
 template ExtMove* generate<NON_EVASIONS>(const Position&, ExtMove*);
 
 
-/// generate<QUIET_CHECKS> generates all pseudo-legal non-captures and knight
+/// generate<QUIET_CHECKS> generates all legal non-captures and knight
 /// underpromotions that give check. Returns a pointer to the end of the move list.
 template<>
 ExtMove* generate<QUIET_CHECKS>(const Position& pos, ExtMove* moveList) {
@@ -285,7 +383,9 @@ ExtMove* generate<QUIET_CHECKS>(const Position& pos, ExtMove* moveList) {
   assert(!pos.checkers());
 
   Color us = pos.side_to_move();
+  Square ksq = pos.square<KING>(us);
   Bitboard dc = pos.blockers_for_king(~us) & pos.pieces(us);
+  Bitboard pinned = pos.blockers_for_king(us) & pos.pieces(us);
 
   while (dc)
   {
@@ -298,10 +398,16 @@ ExtMove* generate<QUIET_CHECKS>(const Position& pos, ExtMove* moveList) {
      Bitboard b = pos.attacks_from(pt, from) & ~pos.pieces();
 
      if (pt == KING)
+     {
          b &= ~PseudoAttacks[QUEEN][pos.square<KING>(~us)];
+         moveList = generate_king_moves(pos, moveList, us, b);
+         continue;
+     }
+
+     if (pinned & from)
+         b &= line_bb(ksq, from);
 
-     while (b)
-         *moveList++ = make_move(from, pop_lsb(&b));
+     moveList = serialize<Direction(0)>(moveList, b, from);
   }
 
   return us == WHITE ? generate_all<WHITE, QUIET_CHECKS>(pos, moveList, ~pos.pieces())
@@ -309,8 +415,8 @@ ExtMove* generate<QUIET_CHECKS>(const Position& pos, ExtMove* moveList) {
 }
 
 
-/// generate<EVASIONS> generates all pseudo-legal check evasions when the side
-/// to move is in check. Returns a pointer to the end of the move list.
+/// generate<EVASIONS> generates all legal check evasions when the side to move
+/// is in check. Returns a pointer to the end of the move list.
 template<>
 ExtMove* generate<EVASIONS>(const Position& pos, ExtMove* moveList) {
 
@@ -318,22 +424,9 @@ ExtMove* generate<EVASIONS>(const Position& pos, ExtMove* moveList) {
 
   Color us = pos.side_to_move();
   Square ksq = pos.square<KING>(us);
-  Bitboard sliderAttacks = 0;
-  Bitboard sliders = pos.checkers() & ~pos.pieces(KNIGHT, PAWN);
-
-  // Find all the squares attacked by slider checkers. We will remove them from
-  // the king evasions in order to skip known illegal moves, which avoids any
-  // useless legality checks later on.
-  while (sliders)
-  {
-      Square checksq = pop_lsb(&sliders);
-      sliderAttacks |= LineBB[checksq][ksq] ^ checksq;
-  }
 
   // Generate evasions for king, capture and non capture moves
-  Bitboard b = pos.attacks_from<KING>(ksq) & ~pos.pieces(us) & ~sliderAttacks;
-  while (b)
-      *moveList++ = make_move(ksq, pop_lsb(&b));
+  moveList = generate_king_moves(pos, moveList, us, pos.attacks_from<KING>(ksq) & ~pos.pieces(us));
 
   if (more_than_one(pos.checkers()))
       return moveList; // Double check, only a king move can save the day
@@ -352,19 +445,6 @@ ExtMove* generate<EVASIONS>(const Position& pos, ExtMove* moveList) {
 template<>
 ExtMove* generate<LEGAL>(const Position& pos, ExtMove* moveList) {
 
-  Color us = pos.side_to_move();
-  Bitboard pinned = pos.blockers_for_king(us) & pos.pieces(us);
-  Square ksq = pos.square<KING>(us);
-  ExtMove* cur = moveList;
-
-  moveList = pos.checkers() ? generate<EVASIONS    >(pos, moveList)
-                            : generate<NON_EVASIONS>(pos, moveList);
-  while (cur != moveList)
-      if (   (pinned || from_sq(*cur) == ksq || type_of(*cur) == ENPASSANT)
-          && !pos.legal(*cur))
-          *cur = (--moveList)->move;
-      else
-          ++cur;
-
-  return moveList;
+  return pos.checkers() ? generate<EVASIONS    >(pos, moveList)
+                        : generate<NON_EVASIONS>(pos, moveList);
 }
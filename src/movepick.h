@@ -104,9 +104,9 @@ typedef Stats<int16_t, 29952, PIECE_NB, SQUARE_NB> PieceToHistory;
 typedef Stats<PieceToHistory, NOT_USED, PIECE_NB, SQUARE_NB> ContinuationHistory;
 
 
-/// MovePicker class is used to pick one pseudo legal move at a time from the
-/// current position. The most important method is next_move(), which returns a
-/// new pseudo legal move each time it is called, until there are no moves left,
+/// MovePicker class is used to pick one legal move at a time from the current
+/// position. The most important method is next_move(), which returns a new
+/// legal move each time it is called, until there are no moves left,
 /// when MOVE_NONE is returned. In order to improve the efficiency of the alpha
 /// beta algorithm, MovePicker attempts to return the moves which are most likely
 /// to get a cut-off first.
@@ -148,4 +148,21 @@ private:
   ExtMove moves[MAX_MOVES];
 };
 
+/// partial_insertion_sort() sorts moves in descending order up to and including
+/// a given limit. The order of moves smaller than the limit is left unspecified.
+/// It is here rather than in movepick.cpp for the microbenchmark harness.
+
+inline void partial_insertion_sort(ExtMove* begin, ExtMove* end, int limit) {
+
+  for (ExtMove *sortedEnd = begin, *p = begin + 1; p < end; ++p)
+      if (p->value >= limit)
+      {
+          ExtMove tmp = *p, *q;
+          *p = *++sortedEnd;
+          for (q = sortedEnd; q != begin && *(q - 1) < tmp; --q)
+              *q = *(q - 1);
+          *q = tmp;
+      }
+}
+
 #endif // #ifndef MOVEPICK_H_INCLUDED
@@ -20,11 +20,16 @@
 
 #include <algorithm>
 #include <cassert>
+#include <cstring>   // For std::memcpy
+#include <iomanip>
+#include <iostream>
+#include <sstream>
 
 #include "bitboard.h"
 #include "pawns.h"
 #include "position.h"
 #include "thread.h"
+#include "uci.h"
 
 namespace {
 
@@ -65,6 +70,25 @@ namespace {
   #undef S
   #undef V
 
+  // The pawn hash table shared by all threads when "Pawn Hash Shared" is set
+  Pawns::Table SharedTable;
+  bool Shared;
+
+  // checksum() folds all the words of an entry, except its key, into one. It
+  // is xor-ed with the key of entries stored in the shared table.
+  static_assert(sizeof(Pawns::Entry) % sizeof(Key) == 0, "Entry size incorrect");
+
+  Key checksum(const Pawns::Entry& e) {
+
+    Key words[sizeof(Pawns::Entry) / sizeof(Key)], sum = 0;
+    std::memcpy(words, &e, sizeof(e));
+
+    for (size_t i = 1; i < sizeof(e) / sizeof(Key); ++i)
+        sum ^= words[i];
+
+    return sum;
+  }
+
   template<Color Us>
   Score evaluate(const Position& pos, Pawns::Entry* e) {
 
@@ -166,19 +190,131 @@ namespace Pawns {
 Entry* probe(const Position& pos) {
 
   Key key = pos.pawn_key();
-  Entry* e = pos.this_thread()->pawnsTable[key];
+  Table& table = pos.this_thread()->pawnsTable;
+  Entry* e = Shared ? &table.local : table[key];
 
   if (e->key == key)
-      return e;
+      return ++table.hits, e;
 
+  Entry* slot = Shared ? SharedTable[key] : nullptr;
+
+  // Copy the shared entry and verify it. The copy is racy, but an entry that
+  // another thread is writing at the same time fails the key check.
+  if (slot)
+  {
+      *e = *slot;
+
+      if ((e->key ^ checksum(*e)) == key)
+      {
+          e->key = key;
+          return ++table.hits, e;
+      }
+  }
+
+  ++table.misses;
   e->key = key;
   e->scores[WHITE] = evaluate<WHITE>(pos, e);
   e->scores[BLACK] = evaluate<BLACK>(pos, e);
 
+  if (slot)
+  {
+      *slot = *e;
+      slot->key = key ^ checksum(*e);
+  }
+
   return e;
 }
 
 
+/// Table::resize() sets the size of the table, measured in megabytes, and resets
+/// its content and statistics. A zero size frees the table. The memory is zeroed
+/// lazily by the OS, so that a big table costs nothing until it is used.
+
+void Table::resize(size_t mbSize) {
+
+  size_t entries = 1;
+
+  while (entries * 2 <= mbSize * 1024 * 1024 / sizeof(Entry))
+      entries *= 2;
+
+  free(table);
+  count = mbSize ? entries : 0;
+  table = count ? (Entry*)calloc(count, sizeof(Entry)) : nullptr;
+
+  if (count && !table)
+  {
+      std::cerr << "Failed to allocate " << mbSize
+                << "MB for pawn hash table." << std::endl;
+      exit(EXIT_FAILURE);
+  }
+
+  local = Entry();
+  hits = misses = 0;
+}
+
+
+/// Pawns::resize() allocates the pawn hash tables according to the "Pawn Hash"
+/// and "Pawn Hash Shared" UCI options. It must be called with threads idle.
+
+void resize() {
+
+  Threads.main()->wait_for_search_finished();
+
+  Shared = Options["Pawn Hash Shared"];
+  SharedTable.resize(Shared ? size_t(Options["Pawn Hash"]) : 0);
+
+  for (Thread* th : Threads)
+      th->pawnsTable.resize(Shared ? 0 : size_t(Options["Pawn Hash"]));
+
+  memory_footprint("Pawn hash", footprint());
+}
+
+
+/// Pawns::footprint() returns the size in bytes of all the pawn hash tables
+
+size_t footprint() {
+
+  return sizeof(Entry) * (Shared ? SharedTable.size()
+                                 : Threads.size() * Threads.main()->pawnsTable.size());
+}
+
+
+/// Pawns::stats() returns a string with the size of the pawn hash tables and
+/// the hit/miss counters of each thread, to be printed by the 'hashstats' command.
+
+std::string stats() {
+
+  std::stringstream ss;
+  uint64_t hits = 0, misses = 0;
+
+  auto line = [&](const std::string& name, uint64_t h, uint64_t m) {
+      ss << std::setw(10) << name
+         << " | hits " << std::setw(12) << h
+         << " | misses " << std::setw(12) << m
+         << " | hit rate (%) " << std::fixed << std::setprecision(2)
+         << (h + m ? 100.0 * h / (h + m) : 0.0) << "\n";
+  };
+
+  size_t entries = Shared ? SharedTable.size() : Threads.front()->pawnsTable.size();
+
+  ss << "Pawn hash: " << (Shared ? "shared, " : "per thread, ") << entries
+     << " entries (" << entries * sizeof(Entry) / 1024 << " KB"
+     << (Shared ? "" : " each") << ")\n";
+
+  for (size_t i = 0; i < Threads.size(); ++i)
+  {
+      const Table& t = Threads[i]->pawnsTable;
+      line("thread " + std::to_string(i), t.hits, t.misses);
+      hits += t.hits;
+      misses += t.misses;
+  }
+
+  line("total", hits, misses);
+
+  return ss.str();
+}
+
+
 /// Entry::evaluate_shelter() calculates the shelter bonus and the storm
 /// penalty for a king, looking at the king file and the two closest files.
 
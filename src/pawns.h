@@ -21,6 +21,9 @@
 #ifndef PAWNS_H_INCLUDED
 #define PAWNS_H_INCLUDED
 
+#include <cstdlib>
+#include <string>
+
 #include "misc.h"
 #include "position.h"
 #include "types.h"
@@ -61,9 +64,37 @@ struct Entry {
   int castlingRights[COLOR_NB];
 };
 
-typedef HashTable<Entry, 131072> Table;
+/// Pawns::Table is a power of 2 number of Entry. Each thread owns one, sized
+/// by the "Pawn Hash" UCI option, unless "Pawn Hash Shared" is set. In that case
+/// the per-thread tables are left empty and all threads probe a single global
+/// table, copying the entry found into their own 'local' Entry. The shared table
+/// is lock-free: entries are stored with their key xor-ed with the rest of their
+/// content, so that an entry torn by a concurrent write is detected on read and
+/// simply recomputed. Hits and misses are counted per thread. A table owns its
+/// calloc'd entries, so it cannot be copied.
+
+struct Table {
+
+  Table() = default;
+  Table(const Table&) = delete;
+  Table& operator=(const Table&) = delete;
+ ~Table() { free(table); }
+  void resize(size_t mbSize);
+  size_t size() const { return count; }
+  Entry* operator[](Key key) { return &table[key & (count - 1)]; }
+
+  Entry local;
+  uint64_t hits, misses;
+
+private:
+  Entry* table = nullptr;
+  size_t count = 0;
+};
 
+void resize();
 Entry* probe(const Position& pos);
+std::string stats();
+size_t footprint();
 
 } // namespace Pawns
 
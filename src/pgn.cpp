@@ -0,0 +1,591 @@
+/*
+  Stockfish, a UCI chess playing engine derived from Glaurung 2.1
+  Copyright (C) 2004-2008 Tord Romstad (Glaurung author)
+  Copyright (C) 2008-2015 Marco Costalba, Joona Kiiski, Tord Romstad
+  Copyright (C) 2015-2020 Marco Costalba, Joona Kiiski, Gary Linscott, Tord Romstad
+
+  Stockfish is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  Stockfish is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <cstdio>  // For EOF
+#include <cstdlib>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <sstream>
+
+#include "misc.h"
+#include "movegen.h"
+#include "pgn.h"
+#include "search.h"
+#include "thread.h"
+#include "uci.h"
+
+using namespace std;
+
+namespace {
+
+  const char* StartFEN = "rnbqkbnr/pppppppp/8/8/8/8/PPPPPPPP/RNBQKBNR w KQkq - 0 1";
+  const string PieceChars(" PNBRQK");
+
+  // Note stores the annotation of a single move of a game
+  struct Note {
+    string move, best, score;
+    int ply, depth;
+  };
+
+  // is_legal() validates a move built from the board instead of generated.
+  // Position::legal() assumes moves from the generator, which only produces
+  // evasions when in check, so in that case the legal move list is used.
+
+  bool is_legal(const Position& pos, Move m) {
+    return pos.checkers() ? MoveList<LEGAL>(pos).contains(m) : pos.legal(m);
+  }
+
+  // tag() returns the value of the given tag of the game, or an empty string
+  const string tag(const PGN::Game& game, const string& name) {
+
+    for (const auto& t : game.tags)
+        if (t.first == name)
+            return t.second;
+
+    return string();
+  }
+
+  // score() formats a value, from White's point of view, as a PGN annotation:
+  // either pawns with two decimals, or "#n" for a mate in n moves.
+
+  string score(Value v) {
+
+    stringstream ss;
+
+    if (abs(v) < VALUE_MATE_IN_MAX_PLY)
+        ss << showpos << fixed << setprecision(2) << double(v) / PawnValueEg;
+    else
+        ss << "#" << (v > 0 ? (VALUE_MATE - v + 1) / 2 : -(VALUE_MATE + v) / 2);
+
+    return ss.str();
+  }
+
+  // escape() returns a string quoted for use in PGN tags and JSON
+  string escape(const string& str) {
+
+    string s = "\"";
+
+    for (char c : str)
+        s += (c == '"' || c == '\\') ? string("\\") + c : string(1, c);
+
+    return s + "\"";
+  }
+
+  // write_pgn() writes a game in PGN export format, with the engine score and
+  // depth, and the best move when it differs from the one played, as comments.
+
+  void write_pgn(ostream& out, const PGN::Game& game, const vector<Note>& notes) {
+
+    string line, token;
+    bool needNumber = true;
+
+    for (const auto& t : game.tags)
+        out << "[" << t.first << " " << escape(t.second) << "]\n";
+
+    out << "\n";
+
+    auto add = [&](const string& tok) {
+        if (!line.empty() && line.size() + tok.size() >= 80)
+        {
+            out << line << "\n";
+            line.clear();
+        }
+        line += (line.empty() ? "" : " ") + tok;
+    };
+
+    for (const Note& n : notes)
+    {
+        if (n.ply % 2 == 0)
+            add(to_string(1 + n.ply / 2) + ". " + n.move);
+        else
+            add(needNumber ? to_string(1 + n.ply / 2) + "... " + n.move : n.move);
+
+        needNumber = !n.score.empty();
+
+        if (needNumber)
+            add("{" + n.score + "/" + to_string(n.depth)
+                    + (n.best != n.move ? " " + n.best : "") + "}");
+    }
+
+    add(game.result.empty() ? "*" : game.result);
+    out << line << "\n\n";
+  }
+
+  // write_json() writes a game as a single line JSON object
+  void write_json(ostream& out, const PGN::Game& game, const vector<Note>& notes) {
+
+    out << "{\"tags\":{";
+
+    for (size_t i = 0; i < game.tags.size(); ++i)
+        out << (i ? "," : "") << escape(game.tags[i].first) << ":" << escape(game.tags[i].second);
+
+    out << "},\"result\":" << escape(game.result.empty() ? "*" : game.result) << ",\"moves\":[";
+
+    for (size_t i = 0; i < notes.size(); ++i)
+    {
+        out << (i ? "," : "") << "{\"move\":" << escape(notes[i].move);
+
+        if (!notes[i].score.empty())
+            out << ",\"score\":" << escape(notes[i].score)
+                << ",\"depth\":" << notes[i].depth
+                << ",\"best\":" << escape(notes[i].best);
+
+        out << "}";
+    }
+
+    out << "]}\n";
+  }
+
+} // namespace
+
+
+namespace PGN {
+
+/// Reader::next() reads the next game of the stream into 'game'. Comments,
+/// variations, NAGs and move numbers are skipped. A game ends with its result
+/// or, if that is missing, with the tags of the following game. Returns false
+/// when there are no more games.
+
+bool Reader::next(Game& game) {
+
+  int c;
+
+  game.tags.clear();
+  game.moves.clear();
+  game.result.clear();
+
+  while ((c = sb->sgetc()) != EOF)
+  {
+      if (isspace(c))
+          sb->sbumpc();
+
+      else if (c == '[')
+      {
+          if (!game.moves.empty())
+              break;
+
+          sb->sbumpc();
+          read_tag(game);
+      }
+      else if (c == '{')
+          skip_until('}');
+
+      else if (c == ';' || c == '%')
+          skip_until('\n');
+
+      else if (c == '(')
+          skip_variation();
+
+      else
+      {
+          string token = read_token();
+
+          if (token.empty()) // Stray closing bracket
+              sb->sbumpc();
+
+          else if (token == "1-0" || token == "0-1" || token == "1/2-1/2" || token == "*")
+          {
+              game.result = token;
+              return true;
+          }
+          else
+          {
+              // Strip move numbers, as in "12." or "12...Nf6"
+              if (isdigit(token[0]) && token.find('-') == string::npos)
+                  token.erase(0, token.find_first_not_of("0123456789."));
+
+              if (!token.empty() && token[0] != '$')
+                  game.moves.push_back(token);
+          }
+      }
+  }
+
+  return !game.tags.empty() || !game.moves.empty();
+}
+
+
+/// Reader::read_token() reads a movetext token, up to a space or a delimiter
+
+string Reader::read_token() {
+
+  string token;
+  int c;
+
+  while (   (c = sb->sgetc()) != EOF && !isspace(c)
+         && c != '{' && c != '}' && c != '(' && c != ')'
+         && c != '[' && c != ']' && c != ';')
+      token += char(sb->sbumpc());
+
+  return token;
+}
+
+
+/// Reader::skip_until() skips everything up to and including 'terminator'
+
+void Reader::skip_until(int terminator) {
+
+  int c;
+
+  while ((c = sb->sbumpc()) != EOF && c != terminator) {}
+}
+
+
+/// Reader::skip_variation() skips a variation, which may hold nested variations
+/// and comments with unbalanced parentheses.
+
+void Reader::skip_variation() {
+
+  int c, depth = 0;
+
+  while ((c = sb->sbumpc()) != EOF)
+      if (c == '(')
+          ++depth;
+
+      else if (c == ')' && --depth == 0)
+          return;
+
+      else if (c == '{')
+          skip_until('}');
+
+      else if (c == ';')
+          skip_until('\n');
+}
+
+
+/// Reader::read_tag() reads a tag pair like [Event "F/S Return Match"], after
+/// the opening bracket.
+
+void Reader::read_tag(Game& game) {
+
+  string name, value;
+  int c;
+
+  while ((c = sb->sgetc()) != EOF && isspace(c))
+      sb->sbumpc();
+
+  while ((c = sb->sgetc()) != EOF && !isspace(c) && c != '"' && c != ']')
+      name += char(sb->sbumpc());
+
+  while ((c = sb->sbumpc()) != EOF && c != '"' && c != ']') {}
+
+  if (c == '"')
+  {
+      while ((c = sb->sbumpc()) != EOF && c != '"')
+          value += char(c == '\\' ? sb->sbumpc() : c);
+
+      skip_until(']');
+  }
+
+  game.tags.emplace_back(name, value);
+}
+
+
+/// PGN::to_move() converts a move in Standard Algebraic Notation to the
+/// corresponding legal move, or MOVE_NONE if there is no such move or more than
+/// one. Check and annotation suffixes are ignored. The candidate origin squares
+/// come straight from the attack bitboards, without generating moves.
+
+Move to_move(const Position& pos, string san) {
+
+  Color us = pos.side_to_move();
+  PieceType pt = PAWN, promotion = NO_PIECE_TYPE;
+  Move move = MOVE_NONE;
+  Bitboard from;
+  size_t idx;
+
+  while (!san.empty() && string("+#!?").find(san.back()) != string::npos)
+      san.pop_back();
+
+  if (san == "O-O" || san == "0-0" || san == "O-O-O" || san == "0-0-0")
+  {
+      CastlingRights cr = us & (san.size() == 3 ? KING_SIDE : QUEEN_SIDE);
+
+      if (!pos.can_castle(cr) || pos.castling_impeded(cr) || pos.checkers())
+          return MOVE_NONE;
+
+      move = make<CASTLING>(pos.square<KING>(us), pos.castling_rook_square(cr));
+      return pos.legal(move) ? move : MOVE_NONE;
+  }
+
+  // Promotion piece, as in "e8=Q" or "e8Q"
+  if (san.size() > 2 && (idx = string("NBRQ").find(san.back())) != string::npos)
+  {
+      promotion = PieceType(KNIGHT + idx);
+      san.pop_back();
+
+      if (san.back() == '=')
+          san.pop_back();
+  }
+
+  if (   san.size() < 2
+      || san[san.size() - 2] < 'a' || san[san.size() - 2] > 'h'
+      || san.back() < '1' || san.back() > '8')
+      return MOVE_NONE;
+
+  Square to = make_square(File(san[san.size() - 2] - 'a'), Rank(san.back() - '1'));
+  san.resize(san.size() - 2);
+
+  if (!san.empty() && (idx = string("NBRQK").find(san[0])) != string::npos)
+  {
+      pt = PieceType(KNIGHT + idx);
+      san.erase(0, 1);
+  }
+
+  if (pos.pieces(us) & to)
+      return MOVE_NONE;
+
+  // What is left is the disambiguation and the capture sign
+  from = pos.pieces(us, pt);
+
+  for (char c : san)
+      if (c >= 'a' && c <= 'h')
+          from &= file_bb(File(c - 'a'));
+
+      else if (c >= '1' && c <= '8')
+          from &= rank_bb(Rank(c - '1'));
+
+      else if (c != 'x' && c != ':' && c != '-')
+          return MOVE_NONE;
+
+  if (pt == PAWN)
+  {
+      if ((relative_rank(us, to) == RANK_8) != (promotion != NO_PIECE_TYPE))
+          return MOVE_NONE;
+
+      if (to == pos.ep_square() || !pos.empty(to))
+          from &= PawnAttacks[~us][to];
+      else
+      {
+          // A push needs a pawn behind the target, which is off the board
+          // for the first rank.
+          if (relative_rank(us, to) <= RANK_2)
+              return MOVE_NONE;
+
+          Square s = to - pawn_push(us);
+          from &= square_bb(pos.empty(s) && relative_rank(us, to) == RANK_4 ? s - pawn_push(us) : s);
+      }
+  }
+  else if (promotion != NO_PIECE_TYPE)
+      return MOVE_NONE;
+  else
+      from &= attacks_bb(pt, to, pos.pieces());
+
+  while (from)
+  {
+      Square s = pop_lsb(&from);
+      Move m =  promotion != NO_PIECE_TYPE ? make<PROMOTION>(s, to, promotion)
+              : pt == PAWN && to == pos.ep_square() ? make<ENPASSANT>(s, to)
+              : make_move(s, to);
+
+      if (is_legal(pos, m))
+      {
+          if (move != MOVE_NONE) // Ambiguous
+              return MOVE_NONE;
+
+          move = m;
+      }
+  }
+
+  return move;
+}
+
+
+/// PGN::san() converts a legal move to Standard Algebraic Notation, with the
+/// minimal disambiguation and a check or mate suffix.
+
+string san(Position& pos, Move m) {
+
+  Square from = from_sq(m), to = to_sq(m);
+  PieceType pt = type_of(pos.moved_piece(m));
+  string s;
+
+  if (type_of(m) == CASTLING)
+      s = to > from ? "O-O" : "O-O-O";
+  else
+  {
+      if (pt == PAWN)
+          s = pos.capture(m) ? string(1, char('a' + file_of(from))) : "";
+      else
+      {
+          Bitboard b = (attacks_bb(pt, to, pos.pieces()) & pos.pieces(pos.side_to_move(), pt)) ^ from;
+          Bitboard others = 0;
+
+          while (b)
+          {
+              Square sq = pop_lsb(&b);
+              if (is_legal(pos, make_move(sq, to)))
+                  others |= sq;
+          }
+
+          s = PieceChars[pt];
+
+          if (others)
+              s += !(others & file_bb(from)) ? string(1, char('a' + file_of(from)))
+                 : !(others & rank_bb(from)) ? string(1, char('1' + rank_of(from)))
+                                             : UCI::square(from);
+      }
+
+      s += (pos.capture(m) ? "x" : "") + UCI::square(to);
+
+      if (type_of(m) == PROMOTION)
+          s += string("=") + PieceChars[promotion_type(m)];
+  }
+
+  if (pos.gives_check(m))
+  {
+      StateInfo st;
+      pos.do_move(m, st, true);
+      s += MoveList<LEGAL>(pos).size() ? "+" : "#";
+      pos.undo_move(m);
+  }
+
+  return s;
+}
+
+
+/// PGN::analyze() is called by the "analyze" command. It reads the games of a
+/// PGN file, searches the position before each move within the given limit and
+/// writes the annotated games, as PGN or, if the output file name ends with
+/// ".json", as one JSON object per line. Limit "none" only replays the games,
+/// which also validates and normalizes their moves.
+///
+/// analyze games.pgn out.pgn -> search each position to depth 10
+/// analyze games.pgn out.json nodes 100000 -> 100K nodes each, JSON output
+/// analyze games.pgn out.pgn none -> only replay the games
+
+void analyze(istream& args) {
+
+  string inName, outName, limitType = "depth", token;
+  int64_t limit = 10;
+  vector<char> buffer(1 << 20);
+  ifstream in;
+  ofstream out;
+
+  args >> inName >> outName;
+
+  if (args >> token)
+      limitType = token;
+
+  if (args >> token)
+      limit = stoll(token);
+
+  bool json = outName.size() > 5 && outName.substr(outName.size() - 5) == ".json";
+
+  in.rdbuf()->pubsetbuf(buffer.data(), buffer.size());
+  in.open(inName, ios::binary);
+  out.open(outName);
+
+  if (!in.is_open() || !out.is_open())
+  {
+      sync_cout << "Unable to open " << (in.is_open() ? outName : inName) << sync_endl;
+      return;
+  }
+
+  in.seekg(0, ios::end);
+  int64_t bytes = in.tellg();
+  in.seekg(0);
+
+  // The pool owns the states of the current UCI position, keep them aside.
+  // Then the states of each game are handed back after every search.
+  StateListPtr uciStates = std::move(Threads.setup_states());
+  Reader reader(in);
+  Game game;
+  Position pos;
+  uint64_t games = 0, plies = 0, illegal = 0;
+  TimePoint elapsed = now();
+
+  if (limitType != "none")
+      Search::clear();
+
+  while (reader.next(game))
+  {
+      StateListPtr states(new std::deque<StateInfo>(1));
+      string fen = tag(game, "FEN");
+      string variant = tag(game, "Variant");
+      bool chess960 = Options["UCI_Chess960"] || variant.find("960") != string::npos
+                                              || variant.find("ischer") != string::npos;
+      vector<Note> notes;
+
+      pos.set(fen.empty() ? StartFEN : fen, chess960, &states->back(), Threads.main());
+
+      for (const string& s : game.moves)
+      {
+          Move m = to_move(pos, s);
+
+          if (m == MOVE_NONE)
+          {
+              sync_cout << "info string Illegal move " << s << " in game " << games + 1 << sync_endl;
+              ++illegal;
+              break;
+          }
+
+          notes.push_back({ san(pos, m), "", "", pos.game_ply(), 0 });
+
+          if (limitType != "none")
+          {
+              Search::LimitsType limits;
+              limits.startTime = now();
+
+              if (limitType == "nodes")
+                  limits.nodes = limit;
+              else if (limitType == "movetime")
+                  limits.movetime = limit;
+              else
+                  limits.depth = int(limit);
+
+              Threads.start_thinking(pos, states, limits);
+              Threads.main()->wait_for_search_finished();
+              states = std::move(Threads.setup_states());
+
+              const Search::RootMove& rm = Threads.main()->rootMoves[0];
+              Value v = rm.score != -VALUE_INFINITE ? rm.score : rm.previousScore;
+
+              notes.back().best = san(pos, rm.pv[0]);
+              notes.back().score = score(pos.side_to_move() == WHITE ? v : -v);
+              notes.back().depth = Threads.main()->completedDepth;
+          }
+
+          states->emplace_back();
+          pos.do_move(m, states->back());
+      }
+
+      if (json)
+          write_json(out, game, notes);
+      else
+          write_pgn(out, game, notes);
+
+      ++games;
+      plies += notes.size();
+  }
+
+  Threads.setup_states() = std::move(uciStates);
+  elapsed = now() - elapsed + 1; // Ensure positivity to avoid a 'divide by zero'
+
+  cerr << "\n==========================="
+       << "\nGames           : " << games
+       << "\nMoves           : " << plies
+       << "\nIllegal moves   : " << illegal
+       << "\nTotal time (ms) : " << elapsed
+       << "\nMoves/second    : " << 1000 * plies / elapsed
+       << "\nMB/second       : " << bytes / 1000 / elapsed << endl;
+}
+
+} // namespace PGN
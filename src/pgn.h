@@ -0,0 +1,67 @@
+/*
+  Stockfish, a UCI chess playing engine derived from Glaurung 2.1
+  Copyright (C) 2004-2008 Tord Romstad (Glaurung author)
+  Copyright (C) 2008-2015 Marco Costalba, Joona Kiiski, Tord Romstad
+  Copyright (C) 2015-2020 Marco Costalba, Joona Kiiski, Gary Linscott, Tord Romstad
+
+  Stockfish is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  Stockfish is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef PGN_H_INCLUDED
+#define PGN_H_INCLUDED
+
+#include <istream>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "position.h"
+#include "types.h"
+
+namespace PGN {
+
+/// Game stores one game of a PGN file as read by Reader: the tag pairs, the
+/// moves of the main line as SAN strings (variations and comments are dropped)
+/// and the game termination marker.
+
+struct Game {
+  std::vector<std::pair<std::string, std::string>> tags;
+  std::vector<std::string> moves;
+  std::string result;
+};
+
+/// Reader extracts the games of a PGN stream one at a time, reading straight
+/// from the stream buffer, so that files of any size can be processed.
+
+class Reader {
+public:
+  explicit Reader(std::istream& is) : sb(is.rdbuf()) {}
+  bool next(Game& game);
+
+private:
+  std::string read_token();
+  void skip_until(int terminator);
+  void skip_variation();
+  void read_tag(Game& game);
+
+  std::streambuf* sb;
+};
+
+Move to_move(const Position& pos, std::string san);
+std::string san(Position& pos, Move m);
+void analyze(std::istream& args);
+
+} // namespace PGN
+
+#endif // #ifndef PGN_H_INCLUDED
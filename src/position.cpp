@@ -155,6 +155,10 @@ void Position::init() {
                   count++;
              }
   assert(count == 3668);
+
+  memory_footprint("Zobrist", sizeof(Zobrist::psq) + sizeof(Zobrist::enpassant)
+                            + sizeof(Zobrist::castling) + 2 * sizeof(Key));
+  memory_footprint("Cuckoo", sizeof(cuckoo) + sizeof(cuckooMove));
 }
 
 
@@ -335,7 +339,7 @@ void Position::set_check_info(StateInfo* si) const {
 
 void Position::set_state(StateInfo* si) const {
 
-  si->key = si->materialKey = 0;
+  si->key = 0;
   si->pawnKey = Zobrist::noPawns;
   si->nonPawnMaterial[WHITE] = si->nonPawnMaterial[BLACK] = VALUE_ZERO;
   si->checkersBB = attackers_to(square<KING>(sideToMove)) & pieces(~sideToMove);
@@ -362,10 +366,22 @@ void Position::set_state(StateInfo* si) const {
       si->key ^= Zobrist::side;
 
   si->key ^= Zobrist::castling[si->castlingRights];
+  si->materialKey = material_key(pieceCount);
+}
+
+
+/// Position::material_key() computes the material key of the material
+/// distribution given by the number of pieces of each kind, kings included.
+
+Key Position::material_key(const int pieceCount[PIECE_NB]) {
+
+  Key key = 0;
 
   for (Piece pc : Pieces)
       for (int cnt = 0; cnt < pieceCount[pc]; ++cnt)
-          si->materialKey ^= Zobrist::psq[pc][cnt];
+          key ^= Zobrist::psq[pc][cnt];
+
+  return key;
 }
 
 
@@ -440,6 +456,174 @@ const string Position::fen() const {
 }
 
 
+/// Position::set_packed() initializes the position object from a PackedPosition.
+/// It is the binary counterpart of set() and needs no parsing at all. As the
+/// records come from files, they are checked first: each side must have one
+/// king, at most 8 pawns and 16 pieces, the pawns and the castling rooks must
+/// stand on possible ranks, an en passant capture must be possible, and the
+/// side not to move must not be in check. On a bad record it returns false and leaves the position unchanged.
+
+bool Position::set_packed(const PackedPosition& pp, bool isChess960, StateInfo* si, Thread* th) {
+
+  Square squares[32], ksq[COLOR_NB] = { SQ_NONE, SQ_NONE };
+  Piece pcs[32];
+  int n = 0, count[PIECE_NB] = {};
+  Bitboard b = pp.occupied, castlingRooks = 0, ourPawns = 0;
+  Square epPawn = SQ_NONE;
+  Color us = Color(pp.sideToMove);
+
+  if (pp.sideToMove > BLACK || popcount(pp.occupied) > 32)
+      return false;
+
+  for ( ; b; ++n)
+  {
+      Square s = pop_lsb(&b);
+      int code = (pp.pieces[n / 2] >> (4 * (n & 1))) & 0xF;
+
+      if ((code & 7) == PackedCastlingRook)
+      {
+          if (relative_rank(Color(code >> 3), s) != RANK_1)
+              return false;
+
+          castlingRooks |= s;
+          code = make_piece(Color(code >> 3), ROOK);
+      }
+      else if (code == PackedEnPassantPawn)
+      {
+          // The pawn has just made a double push, so the square it passed
+          // over and the one it came from must be empty.
+          if (   epPawn != SQ_NONE
+              || relative_rank(~us, s) != RANK_4
+              || (pp.occupied & (s + pawn_push(us)))
+              || (pp.occupied & (s + pawn_push(us) + pawn_push(us))))
+              return false;
+
+          epPawn = s;
+          code = make_piece(~us, PAWN);
+      }
+      else if (code == NO_PIECE)
+          return false;
+
+      Piece pc = Piece(code);
+
+      if (type_of(pc) == PAWN && (rank_of(s) == RANK_1 || rank_of(s) == RANK_8))
+          return false;
+
+      if (type_of(pc) == KING)
+          ksq[color_of(pc)] = s;
+
+      if (pc == make_piece(us, PAWN))
+          ourPawns |= s;
+
+      squares[n] = s;
+      pcs[n] = pc;
+      ++count[pc];
+  }
+
+  // As in set(), an en passant square is kept only if one of our pawns can
+  // capture on it, and pack() writes no other.
+  if (epPawn != SQ_NONE && !(PawnAttacks[~us][epPawn + pawn_push(us)] & ourPawns))
+      return false;
+
+  for (Color c : { WHITE, BLACK })
+  {
+      int total = 0;
+      for (PieceType pt = PAWN; pt <= KING; ++pt)
+          total += count[make_piece(c, pt)];
+
+      if (   count[make_piece(c, KING)] != 1
+          || count[make_piece(c, PAWN)] > 8
+          || total > 16)
+          return false;
+
+      // Castling needs the king on the first rank too
+      if (   (castlingRooks & rank_bb(relative_rank(c, RANK_1)))
+          && relative_rank(c, ksq[c]) != RANK_1)
+          return false;
+  }
+
+  for (int i = 0; i < n; ++i)
+      if (color_of(pcs[i]) == us)
+      {
+          Bitboard attacks = type_of(pcs[i]) == PAWN ? PawnAttacks[us][squares[i]]
+                                                     : attacks_bb(type_of(pcs[i]), squares[i], pp.occupied);
+          if (attacks & ksq[~us])
+              return false;
+      }
+
+  std::memset(this, 0, sizeof(Position));
+  std::memset(si, 0, sizeof(StateInfo));
+  std::fill_n(&pieceList[0][0], sizeof(pieceList) / sizeof(Square), SQ_NONE);
+  st = si;
+
+  sideToMove = us;
+
+  // The squares are in ascending order: put the pieces rank by rank from the
+  // 8th, as set() does, so that the piece lists and thus the move ordering
+  // are the same as for the FEN of the position.
+  for (int end = n, begin; end > 0; end = begin)
+  {
+      begin = end - 1;
+      while (begin > 0 && rank_of(squares[begin - 1]) == rank_of(squares[end - 1]))
+          --begin;
+
+      for (int i = begin; i < end; ++i)
+          put_piece(pcs[i], squares[i]);
+  }
+
+  // Castling rights need the kings on the board, so set them last
+  while (castlingRooks)
+  {
+      Square rsq = pop_lsb(&castlingRooks);
+      set_castling_right(color_of(piece_on(rsq)), rsq);
+  }
+
+  st->epSquare = epPawn != SQ_NONE ? epPawn + pawn_push(us) : SQ_NONE;
+  st->rule50 = pp.rule50;
+  gamePly = std::max(2 * (pp.fullmove - 1), 0) + (us == BLACK);
+
+  chess960 = isChess960;
+  thisThread = th;
+  set_state(st);
+
+  assert(pos_is_ok());
+
+  return true;
+}
+
+
+/// Position::pack() returns the PackedPosition encoding of the position. The
+/// halfmove clock saturates at 255, which is beyond any meaningful value.
+
+PackedPosition Position::pack() const {
+
+  PackedPosition pp = {};
+  Bitboard b = pp.occupied = pieces();
+  Bitboard castlingRooks = 0;
+  Square epPawn = ep_square() != SQ_NONE ? ep_square() - pawn_push(sideToMove) : SQ_NONE;
+
+  for (CastlingRights cr : { WHITE_OO, WHITE_OOO, BLACK_OO, BLACK_OOO })
+      if (can_castle(cr))
+          castlingRooks |= castling_rook_square(cr);
+
+  for (int i = 0; b; ++i)
+  {
+      Square s = pop_lsb(&b);
+      int code =  s == epPawn          ? PackedEnPassantPawn
+                : castlingRooks & s    ? PackedCastlingRook + 8 * color_of(piece_on(s))
+                                       : int(piece_on(s));
+
+      pp.pieces[i / 2] |= uint8_t(code << (4 * (i & 1)));
+  }
+
+  pp.sideToMove = uint8_t(sideToMove);
+  pp.rule50     = uint8_t(std::min(st->rule50, 255));
+  pp.fullmove   = uint16_t(1 + (gamePly - (sideToMove == BLACK)) / 2);
+
+  return pp;
+}
+
+
 /// Position::slider_blockers() returns a bitboard of all the pieces (both colors)
 /// that are blocking attacks on the square 's' from 'sliders'. A piece blocks a
 /// slider if removing that piece from the board would result in a position where
@@ -755,10 +939,9 @@ void Position::do_move(Move m, StateInfo& newSt, bool givesCheck) {
       // Update board and piece lists
       remove_piece(captured, capsq);
 
-      // Update material hash key and prefetch access to materialTable
+      // Update material hash key
       k ^= Zobrist::psq[captured][capsq];
       st->materialKey ^= Zobrist::psq[captured][pieceCount[captured]];
-      prefetch(thisThread->materialTable[st->materialKey]);
 
       // Reset rule 50 counter
       st->rule50 = 0;
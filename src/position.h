@@ -63,6 +63,29 @@ struct StateInfo {
 typedef std::unique_ptr<std::deque<StateInfo>> StateListPtr;
 
 
+/// PackedPosition is a compact 32-byte binary encoding of a position, used for
+/// files of many positions where FEN parsing and formatting would dominate.
+/// The pieces are stored as 4-bit codes in the order of the squares set in
+/// 'occupied', two per byte starting with the low nibble. A code is the Piece
+/// value, except for a rook with a castling right (PackedCastlingRook, plus 8
+/// for Black) and for the pawn which has just made a double push that allows
+/// an en passant capture (PackedEnPassantPawn). Fields are in host byte order.
+
+constexpr int PackedCastlingRook  = 7;
+constexpr int PackedEnPassantPawn = 8;
+
+struct PackedPosition {
+  Bitboard occupied;
+  uint8_t  pieces[16];
+  uint8_t  sideToMove;
+  uint8_t  rule50;
+  uint16_t fullmove;
+  uint8_t  padding[4];
+};
+
+static_assert(sizeof(PackedPosition) == 32, "PackedPosition must be 32 bytes");
+
+
 /// Position class stores information regarding the board representation as
 /// pieces, side to move, hash keys, castling info, etc. Important methods are
 /// do_move() and undo_move(), used by the search to update node info when
@@ -72,6 +95,7 @@ class Thread;
 class Position {
 public:
   static void init();
+  static Key material_key(const int pieceCount[PIECE_NB]);
 
   Position() = default;
   Position(const Position&) = delete;
@@ -82,6 +106,10 @@ public:
   Position& set(const std::string& code, Color c, StateInfo* si);
   const std::string fen() const;
 
+  // Packed binary input/output
+  bool set_packed(const PackedPosition& pp, bool isChess960, StateInfo* si, Thread* th);
+  PackedPosition pack() const;
+
   // Position representation
   Bitboard pieces() const;
   Bitboard pieces(PieceType pt) const;
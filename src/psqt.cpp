@@ -20,6 +20,7 @@
 
 #include <algorithm>
 
+#include "misc.h"
 #include "types.h"
 
 Value PieceValue[PHASE_NB][PIECE_NB] = {
@@ -125,6 +126,8 @@ void init() {
           psq[~pc][~s] = -psq[pc][s];
       }
   }
+
+  memory_footprint("PSQT", sizeof(psq));
 }
 
 } // namespace PSQT
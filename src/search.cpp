@@ -22,10 +22,13 @@
 #include <cassert>
 #include <cmath>
 #include <cstring>   // For std::memset
+#include <iomanip>
 #include <iostream>
 #include <sstream>
 
+#include "cluster.h"
 #include "evaluate.h"
+#include "mate.h"
 #include "misc.h"
 #include "movegen.h"
 #include "movepick.h"
@@ -73,6 +76,18 @@ namespace {
   // Reductions lookup table, initialized at startup
   int Reductions[MAX_MOVES]; // [depth or moveNumber]
 
+  // stat() counts a pruning or extension step of the search at the given depth.
+  // It compiles to nothing unless the build enables USE_STATS.
+  void stat(Thread* th, StatsStep s, Depth d, bool succeeded) {
+#ifdef USE_STATS
+    int i = std::min(int(d), STATS_DEPTH_NB - 1);
+    th->stats.tried[s][i]++;
+    th->stats.succeeded[s][i] += succeeded;
+#else
+    (void)th, (void)s, (void)d, (void)succeeded;
+#endif
+  }
+
   Depth reduction(bool i, Depth d, int mn) {
     int r = Reductions[d] * Reductions[mn];
     return (r + 511) / 1024 + (!i && r > 1007);
@@ -92,6 +107,19 @@ namespace {
     return VALUE_DRAW + Value(2 * (thisThread->nodes & 1) - 1);
   }
 
+  // info_due() rate limits the info lines of the main thread to one every
+  // 'Info Interval' milliseconds, next being when the following one is due.
+  bool info_due(MainThread* mainThread, TimePoint& next) {
+
+    TimePoint elapsed = Time.elapsed();
+
+    if (elapsed < next)
+        return false;
+
+    next = elapsed + mainThread->infoInterval;
+    return true;
+  }
+
   // Skill structure is used to implement strength limit
   struct Skill {
     explicit Skill(int l) : level(l) {}
@@ -103,6 +131,16 @@ namespace {
     Move best = MOVE_NONE;
   };
 
+#ifdef SINGLE_THREAD
+
+  // No other thread can be searching the same node
+  struct ThreadHolding {
+    ThreadHolding(Thread*, Key, int) {}
+    bool marked() { return false; }
+  };
+
+#else
+
   // Breadcrumbs are used to mark nodes as being searched by a given thread
   struct Breadcrumb {
     std::atomic<Thread*> thread;
@@ -146,6 +184,8 @@ namespace {
     bool otherThread, owning;
   };
 
+#endif
+
   template <NodeType NT>
   Value search(Position& pos, Stack* ss, Value alpha, Value beta, Depth depth, bool cutNode);
 
@@ -195,6 +235,8 @@ void Search::init() {
 
   for (int i = 1; i < MAX_MOVES; ++i)
       Reductions[i] = int((24.8 + std::log(Threads.size()) / 2) * std::log(i));
+
+  memory_footprint("Reductions", sizeof(Reductions));
 }
 
 
@@ -207,10 +249,113 @@ void Search::clear() {
   Time.availableNodes = 0;
   TT.clear();
   Threads.clear();
+  Mate::clear();
   Tablebases::init(Options["SyzygyPath"]); // Free mapped files
 }
 
 
+/// Search::stats() reports the counters of the pruning and extension steps,
+/// summed over the threads since the last 'ucinewgame', then by depth and by
+/// thread. The counters are only collected in builds with USE_STATS.
+
+const string Search::stats() {
+
+#ifndef USE_STATS
+  return "Search statistics are not collected, build with 'make build stats=yes'";
+#else
+  const char* Names[]   = { "Razoring", "Static futility", "Null move", "Null verification",
+                            "ProbCut", "Countermove pruning", "Move futility", "SEE pruning",
+                            "Singular extension", "Multi-cut", "LMR" };
+  const char* Success[] = { "qsearch fails low", "node pruned", "null search fails high",
+                            "verification fails high", "node pruned", "move pruned",
+                            "move pruned", "move pruned", "move extended", "node pruned",
+                            "no re-search" };
+  const char* Short[]   = { "Razor", "SFut", "Null", "NVer", "PCut", "CMP",
+                            "MFut", "SEE", "Sing", "MCut", "LMR" };
+
+  SearchStats total = {};
+  int maxDepth = 1;
+
+  for (Thread* th : Threads)
+      for (int s = 0; s < STATS_STEP_NB; ++s)
+          for (int d = 0; d < STATS_DEPTH_NB; ++d)
+          {
+              total.tried[s][d] += th->stats.tried[s][d];
+              total.succeeded[s][d] += th->stats.succeeded[s][d];
+
+              if (th->stats.tried[s][d])
+                  maxDepth = std::max(maxDepth, d);
+          }
+
+  auto rate = [](uint64_t succeeded, uint64_t tried) {
+      std::stringstream ss;
+      if (tried)
+          ss << std::fixed << std::setprecision(1) << 100.0 * succeeded / tried;
+      else
+          ss << "-";
+      return ss.str();
+  };
+
+  auto sum = [](const uint64_t counts[STATS_DEPTH_NB]) {
+      uint64_t n = 0;
+      for (int d = 0; d < STATS_DEPTH_NB; ++d)
+          n += counts[d];
+      return n;
+  };
+
+  std::stringstream ss;
+
+  ss << "Search statistics of " << Threads.size() << " thread(s)\n\n"
+     << std::left  << std::setw(20) << "Step"
+     << std::right << std::setw(14) << "Tried" << std::setw(14) << "Succeeded"
+     << std::setw(8) << "Rate %" << "  Success means\n";
+
+  for (int s = 0; s < STATS_STEP_NB; ++s)
+      ss << std::left  << std::setw(20) << Names[s]
+         << std::right << std::setw(14) << sum(total.tried[s])
+         << std::setw(14) << sum(total.succeeded[s])
+         << std::setw(8) << rate(sum(total.succeeded[s]), sum(total.tried[s]))
+         << "  " << Success[s] << "\n";
+
+  ss << "\nTried by depth (last row includes deeper)\n" << std::setw(6) << "Depth";
+  for (int s = 0; s < STATS_STEP_NB; ++s)
+      ss << std::setw(11) << Short[s];
+
+  for (int d = 1; d <= maxDepth; ++d)
+  {
+      ss << "\n" << std::setw(6) << d;
+      for (int s = 0; s < STATS_STEP_NB; ++s)
+          ss << std::setw(11) << total.tried[s][d];
+  }
+
+  ss << "\n\nSuccess rate % by depth\n" << std::setw(6) << "Depth";
+  for (int s = 0; s < STATS_STEP_NB; ++s)
+      ss << std::setw(7) << Short[s];
+
+  for (int d = 1; d <= maxDepth; ++d)
+  {
+      ss << "\n" << std::setw(6) << d;
+      for (int s = 0; s < STATS_STEP_NB; ++s)
+          ss << std::setw(7) << rate(total.succeeded[s][d], total.tried[s][d]);
+  }
+
+  ss << "\n\nSuccess rate % by thread\n" << std::setw(6) << "Thread";
+  for (int s = 0; s < STATS_STEP_NB; ++s)
+      ss << std::setw(7) << Short[s];
+
+  for (size_t i = 0; i < Threads.size(); ++i)
+  {
+      ss << "\n" << std::setw(6) << i;
+      for (int s = 0; s < STATS_STEP_NB; ++s)
+          ss << std::setw(7) << rate(sum(Threads[i]->stats.succeeded[s]),
+                                     sum(Threads[i]->stats.tried[s]));
+  }
+
+  return ss.str();
+#endif
+}
+
+
 /// MainThread::search() is started when the program receives the UCI 'go'
 /// command. It searches from the root position and outputs the "bestmove".
 
@@ -227,6 +372,10 @@ void MainThread::search() {
   Time.init(Limits, us, rootPos.game_ply());
   TT.new_search();
 
+  infoInterval = Options["Info Interval"];
+  nextInfo = nextCurrmove = 0;
+  infoHeld = false;
+
   if (rootMoves.empty())
   {
       rootMoves.emplace_back(MOVE_NONE);
@@ -234,6 +383,8 @@ void MainThread::search() {
                 << UCI::value(rootPos.checkers() ? -VALUE_MATE : VALUE_DRAW)
                 << sync_endl;
   }
+  else if (Limits.mate && Mate::solve(rootPos, rootMoves, Limits.mate))
+  {} // The proof-number solver found a mate or was stopped
   else
   {
       for (Thread* th : Threads)
@@ -264,6 +415,10 @@ void MainThread::search() {
       if (th != this)
           th->wait_for_search_finished();
 
+  // In a cluster, stop the workers too and get their best moves
+  std::vector<Cluster::Result> remote = Cluster::collect();
+  const Cluster::Result* bestRemote = nullptr;
+
   // When playing in 'nodes as time' mode, subtract the searched nodes from
   // the available ones before exiting.
   if (Limits.npmsec)
@@ -272,7 +427,8 @@ void MainThread::search() {
   Thread* bestThread = this;
 
   // Check if there are threads with a better score than main thread
-  if (    Options["MultiPV"] == 1
+  if (   (!SingleThread || !remote.empty())
+      &&  Options["MultiPV"] == 1
       && !Limits.depth
       && !(Skill(Options["Skill Level"]).enabled() || Options["UCI_LimitStrength"])
       &&  rootMoves[0].pv[0] != MOVE_NONE)
@@ -284,6 +440,9 @@ void MainThread::search() {
       for (Thread* th: Threads)
           minScore = std::min(minScore, th->rootMoves[0].score);
 
+      for (const Cluster::Result& r : remote)
+          minScore = std::min(minScore, r.rootMove.score);
+
       // Vote according to score and depth, and select the best thread
       for (Thread* th : Threads)
       {
@@ -300,12 +459,47 @@ void MainThread::search() {
                    || votes[th->rootMoves[0].pv[0]] > votes[bestThread->rootMoves[0].pv[0]])
               bestThread = th;
       }
+
+      // The workers of a cluster vote as well
+      for (const Cluster::Result& r : remote)
+      {
+          if (   r.rootMove.pv.empty()
+              || std::find(rootMoves.begin(), rootMoves.end(), r.rootMove.pv[0]) == rootMoves.end())
+              continue;
+
+          const Search::RootMove& best = bestRemote ? bestRemote->rootMove : bestThread->rootMoves[0];
+
+          votes[r.rootMove.pv[0]] += (r.rootMove.score - minScore + 14) * int(r.depth);
+
+          if (best.score >= VALUE_MATE_IN_MAX_PLY)
+          {
+              if (r.rootMove.score > best.score)
+                  bestRemote = &r;
+          }
+          else if (   r.rootMove.score >= VALUE_MATE_IN_MAX_PLY
+                   || votes[r.rootMove.pv[0]] > votes[best.pv[0]])
+              bestRemote = &r;
+      }
   }
 
+  // A worker's best move replaces ours, and is sent with its PV
+  if (bestRemote)
+  {
+      bestThread = this;
+      completedDepth = bestRemote->depth;
+      std::swap(rootMoves[0], *std::find(rootMoves.begin(), rootMoves.end(), bestRemote->rootMove.pv[0]));
+      rootMoves[0].pv = bestRemote->rootMove.pv;
+      rootMoves[0].score = bestRemote->rootMove.score;
+      sync_cout << UCI::pv(rootPos, completedDepth, -VALUE_INFINITE, VALUE_INFINITE) << sync_endl;
+  }
+
+  Cluster::report(bestThread->rootMoves[0], bestThread->completedDepth);
+
   previousScore = bestThread->rootMoves[0].score;
 
-  // Send again PV info if we have a new best thread
-  if (bestThread != this)
+  // Send again PV info if we have a new best thread, or if the last one was
+  // held back by the rate limit.
+  if (bestThread != this || infoHeld)
       sync_cout << UCI::pv(bestThread->rootPos, bestThread->completedDepth, -VALUE_INFINITE, VALUE_INFINITE) << sync_endl;
 
   sync_cout << "bestmove " << UCI::move(bestThread->rootMoves[0].pv[0], rootPos.is_chess960());
@@ -332,7 +526,7 @@ void Thread::search() {
   Value bestValue, alpha, beta, delta;
   Move  lastBestMove = MOVE_NONE;
   Depth lastBestMoveDepth = 0;
-  MainThread* mainThread = (this == Threads.main() ? Threads.main() : nullptr);
+  MainThread* mainThread = (this == Threads.main() && !Threads.selfPlay ? Threads.main() : nullptr);
   double timeReduction = 1, totBestMoveChanges = 0;
   Color us = rootPos.side_to_move();
   int iterIdx = 0;
@@ -396,9 +590,11 @@ void Thread::search() {
   int searchAgainCounter = 0;
 
   // Iterative deepening loop until requested to stop or the target depth is reached
+  // In self-play each thread stops by itself, checking nodes between iterations.
   while (   ++rootDepth < MAX_PLY
          && !Threads.stop
-         && !(Limits.depth && mainThread && rootDepth > Limits.depth))
+         && !(Limits.depth && (mainThread || Threads.selfPlay) && rootDepth > Limits.depth)
+         && !(Limits.nodes && Threads.selfPlay && nodes >= uint64_t(Limits.nodes)))
   {
       // Age out PV variability metric
       if (mainThread)
@@ -472,7 +668,8 @@ void Thread::search() {
               if (   mainThread
                   && multiPV == 1
                   && (bestValue <= alpha || bestValue >= beta)
-                  && Time.elapsed() > 3000)
+                  && Time.elapsed() > 3000
+                  && info_due(mainThread, mainThread->nextInfo))
                   sync_cout << UCI::pv(rootPos, rootDepth, alpha, beta) << sync_endl;
 
               // In case of failing low/high increase aspiration window and
@@ -507,7 +704,12 @@ void Thread::search() {
 
           if (    mainThread
               && (Threads.stop || pvIdx + 1 == multiPV || Time.elapsed() > 3000))
-              sync_cout << UCI::pv(rootPos, rootDepth, alpha, beta) << sync_endl;
+          {
+              mainThread->infoHeld = !Threads.stop && !info_due(mainThread, mainThread->nextInfo);
+
+              if (!mainThread->infoHeld)
+                  sync_cout << UCI::pv(rootPos, rootDepth, alpha, beta) << sync_endl;
+          }
       }
 
       if (!Threads.stop)
@@ -640,7 +842,7 @@ namespace {
     maxValue = VALUE_INFINITE;
 
     // Check for the available remaining time
-    if (thisThread == Threads.main())
+    if (thisThread == Threads.main() && !Threads.selfPlay)
         static_cast<MainThread*>(thisThread)->check_time();
 
     // Used to send selDepth info to GUI (selDepth counts from 1, ply from 0)
@@ -823,7 +1025,11 @@ namespace {
     if (   !rootNode // The required rootNode PV handling is not available in qsearch
         &&  depth < 2
         &&  eval <= alpha - RazorMargin)
-        return qsearch<NT>(pos, ss, alpha, beta);
+    {
+        value = qsearch<NT>(pos, ss, alpha, beta);
+        stat(thisThread, RAZORING, depth, value <= alpha);
+        return value;
+    }
 
     improving =  (ss-2)->staticEval == VALUE_NONE ? (ss->staticEval >= (ss-4)->staticEval
               || (ss-4)->staticEval == VALUE_NONE) : ss->staticEval >= (ss-2)->staticEval;
@@ -833,7 +1039,10 @@ namespace {
         &&  depth < 6
         &&  eval - futility_margin(depth, improving) >= beta
         &&  eval < VALUE_KNOWN_WIN) // Do not return unproven wins
+    {
+        stat(thisThread, STATIC_FUTILITY, depth, true);
         return eval;
+    }
 
     // Step 9. Null move search with verification search (~40 Elo)
     if (   !PvNode
@@ -860,6 +1069,8 @@ namespace {
 
         pos.undo_null_move();
 
+        stat(thisThread, NULL_MOVE, depth, nullValue >= beta);
+
         if (nullValue >= beta)
         {
             // Do not return unproven mate scores
@@ -880,6 +1091,8 @@ namespace {
 
             thisThread->nmpMinPly = 0;
 
+            stat(thisThread, NULL_VERIFICATION, depth, v >= beta);
+
             if (v >= beta)
                 return nullValue;
         }
@@ -898,7 +1111,7 @@ namespace {
 
         while (  (move = mp.next_move()) != MOVE_NONE
                && probCutCount < 2 + 2 * cutNode)
-            if (move != excludedMove && pos.legal(move))
+            if (move != excludedMove)
             {
                 assert(pos.capture_or_promotion(move));
                 assert(depth >= 5);
@@ -924,8 +1137,13 @@ namespace {
                 pos.undo_move(move);
 
                 if (value >= raisedBeta)
+                {
+                    stat(thisThread, PROBCUT, depth, true);
                     return value;
+                }
             }
+
+        stat(thisThread, PROBCUT, depth, false);
     }
 
     // Step 11. Internal iterative deepening (~1 Elo)
@@ -959,7 +1177,7 @@ moves_loop: // When in check, search starts from here
     // Mark this node as being searched
     ThreadHolding th(thisThread, posKey, ss->ply);
 
-    // Step 12. Loop through all pseudo-legal moves until no moves remain
+    // Step 12. Loop through all legal moves until no moves remain
     // or a beta cutoff occurs.
     while ((move = mp.next_move(moveCountPruning)) != MOVE_NONE)
     {
@@ -978,7 +1196,8 @@ moves_loop: // When in check, search starts from here
 
       ss->moveCount = ++moveCount;
 
-      if (rootNode && thisThread == Threads.main() && Time.elapsed() > 3000)
+      if (   rootNode && thisThread == Threads.main() && !Threads.selfPlay && Time.elapsed() > 3000
+          && info_due(Threads.main(), Threads.main()->nextCurrmove))
           sync_cout << "info depth " << depth
                     << " currmove " << UCI::move(move, pos.is_chess960())
                     << " currmovenumber " << moveCount + thisThread->pvIdx << sync_endl;
@@ -1008,27 +1227,42 @@ moves_loop: // When in check, search starts from here
               int lmrDepth = std::max(newDepth - reduction(improving, depth, moveCount), 0);
 
               // Countermoves based pruning (~20 Elo)
-              if (   lmrDepth < 4 + ((ss-1)->statScore > 0 || (ss-1)->moveCount == 1)
-                  && (*contHist[0])[movedPiece][to_sq(move)] < CounterMovePruneThreshold
-                  && (*contHist[1])[movedPiece][to_sq(move)] < CounterMovePruneThreshold)
+              bool prune =   lmrDepth < 4 + ((ss-1)->statScore > 0 || (ss-1)->moveCount == 1)
+                          && (*contHist[0])[movedPiece][to_sq(move)] < CounterMovePruneThreshold
+                          && (*contHist[1])[movedPiece][to_sq(move)] < CounterMovePruneThreshold;
+
+              stat(thisThread, COUNTERMOVE_PRUNING, depth, prune);
+              if (prune)
                   continue;
 
               // Futility pruning: parent node (~5 Elo)
-              if (   lmrDepth < 6
-                  && !inCheck
-                  && ss->staticEval + 235 + 172 * lmrDepth <= alpha
-                  &&  thisThread->mainHistory[us][from_to(move)]
-                    + (*contHist[0])[movedPiece][to_sq(move)]
-                    + (*contHist[1])[movedPiece][to_sq(move)]
-                    + (*contHist[3])[movedPiece][to_sq(move)] < 25000)
+              prune =   lmrDepth < 6
+                     && !inCheck
+                     && ss->staticEval + 235 + 172 * lmrDepth <= alpha
+                     &&  thisThread->mainHistory[us][from_to(move)]
+                       + (*contHist[0])[movedPiece][to_sq(move)]
+                       + (*contHist[1])[movedPiece][to_sq(move)]
+                       + (*contHist[3])[movedPiece][to_sq(move)] < 25000;
+
+              stat(thisThread, MOVE_FUTILITY, depth, prune);
+              if (prune)
                   continue;
 
               // Prune moves with negative SEE (~20 Elo)
-              if (!pos.see_ge(move, Value(-(32 - std::min(lmrDepth, 18)) * lmrDepth * lmrDepth)))
+              prune = !pos.see_ge(move, Value(-(32 - std::min(lmrDepth, 18)) * lmrDepth * lmrDepth));
+
+              stat(thisThread, SEE_PRUNING, depth, prune);
+              if (prune)
                   continue;
           }
-          else if (!pos.see_ge(move, Value(-194) * depth)) // (~25 Elo)
+          else
+          {
+              bool prune = !pos.see_ge(move, Value(-194) * depth); // (~25 Elo)
+
+              stat(thisThread, SEE_PRUNING, depth, prune);
+              if (prune)
                   continue;
+          }
       }
 
       // Step 14. Extensions (~75 Elo)
@@ -1045,8 +1279,7 @@ moves_loop: // When in check, search starts from here
        /* &&  ttValue != VALUE_NONE Already implicit in the next condition */
           &&  abs(ttValue) < VALUE_KNOWN_WIN
           && (tte->bound() & BOUND_LOWER)
-          &&  tte->depth() >= depth - 3
-          &&  pos.legal(move))
+          &&  tte->depth() >= depth - 3)
       {
           Value singularBeta = ttValue - 2 * depth;
           Depth halfDepth = depth / 2;
@@ -1054,6 +1287,8 @@ moves_loop: // When in check, search starts from here
           value = search<NonPV>(pos, ss, singularBeta - 1, singularBeta, halfDepth, cutNode);
           ss->excludedMove = MOVE_NONE;
 
+          stat(thisThread, SINGULAR, depth, value < singularBeta);
+
           if (value < singularBeta)
           {
               extension = 1;
@@ -1065,8 +1300,13 @@ moves_loop: // When in check, search starts from here
           // search without the ttMove. So we assume this expected Cut-node is not singular,
           // that multiple moves fail high, and we can prune the whole subtree by returning
           // a soft bound.
-          else if (singularBeta >= beta)
-              return singularBeta;
+          else
+          {
+              stat(thisThread, MULTI_CUT, depth, singularBeta >= beta);
+
+              if (singularBeta >= beta)
+                  return singularBeta;
+          }
       }
 
       // Check extension (~2 Elo)
@@ -1095,12 +1335,7 @@ moves_loop: // When in check, search starts from here
       // Speculative prefetch as early as possible
       prefetch(TT.first_entry(pos.key_after(move)));
 
-      // Check for legality just before making the move
-      if (!rootNode && !pos.legal(move))
-      {
-          ss->moveCount = --moveCount;
-          continue;
-      }
+      assert(pos.legal(move));
 
       // Update the current move (this must be done after singular extension search)
       ss->currentMove = move;
@@ -1195,6 +1430,8 @@ moves_loop: // When in check, search starts from here
           value = -search<NonPV>(pos, ss+1, -(alpha+1), -alpha, d, true);
 
           doFullDepthSearch = (value > alpha && d != newDepth), didLMR = true;
+
+          stat(thisThread, LMR, depth, !doFullDepthSearch);
       }
       else
           doFullDepthSearch = !PvNode || moveCount > 1, didLMR = false;
@@ -1504,12 +1741,7 @@ moves_loop: // When in check, search starts from here
       // Speculative prefetch as early as possible
       prefetch(TT.first_entry(pos.key_after(move)));
 
-      // Check for legality just before making the move
-      if (!pos.legal(move))
-      {
-          moveCount--;
-          continue;
-      }
+      assert(pos.legal(move));
 
       ss->currentMove = move;
       ss->continuationHistory = &thisThread->continuationHistory[inCheck]
@@ -1722,6 +1954,10 @@ void MainThread::check_time() {
   // When using nodes, ensure checking rate is not lower than 0.1% of nodes
   callsCnt = Limits.nodes ? std::min(1024, int(Limits.nodes / 1024)) : 1024;
 
+  // Store the TT entries received from the other processes of a cluster
+  if (Cluster::Active)
+      Cluster::store();
+
   static TimePoint lastInfoTime = now();
 
   TimePoint elapsed = Time.elapsed();
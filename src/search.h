@@ -21,6 +21,7 @@
 #ifndef SEARCH_H_INCLUDED
 #define SEARCH_H_INCLUDED
 
+#include <string>
 #include <vector>
 
 #include "misc.h"
@@ -78,6 +79,24 @@ struct RootMove {
 typedef std::vector<RootMove> RootMoves;
 
 
+/// StatsStep lists the pruning and extension steps of search() that are counted
+/// in builds with USE_STATS (make stats=yes). For each step and each depth, a
+/// thread counts how often the step is tried and how often it succeeds.
+
+enum StatsStep {
+  RAZORING, STATIC_FUTILITY, NULL_MOVE, NULL_VERIFICATION, PROBCUT,
+  COUNTERMOVE_PRUNING, MOVE_FUTILITY, SEE_PRUNING, SINGULAR, MULTI_CUT, LMR,
+  STATS_STEP_NB
+};
+
+constexpr int STATS_DEPTH_NB = 32; // Deeper steps are counted at the last depth
+
+struct SearchStats {
+  uint64_t tried[STATS_STEP_NB][STATS_DEPTH_NB];
+  uint64_t succeeded[STATS_STEP_NB][STATS_DEPTH_NB];
+};
+
+
 /// LimitsType struct stores information sent by GUI about available time to
 /// search the current move, maximum depth/time, or if we are in analysis mode.
 
@@ -103,6 +122,7 @@ extern LimitsType Limits;
 
 void init();
 void clear();
+const std::string stats();
 
 } // namespace Search
 
@@ -0,0 +1,584 @@
+/*
+  Stockfish, a UCI chess playing engine derived from Glaurung 2.1
+  Copyright (C) 2004-2008 Tord Romstad (Glaurung author)
+  Copyright (C) 2008-2015 Marco Costalba, Joona Kiiski, Tord Romstad
+  Copyright (C) 2015-2020 Marco Costalba, Joona Kiiski, Gary Linscott, Tord Romstad
+
+  Stockfish is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  Stockfish is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+
+#include <algorithm>
+#include <condition_variable>
+#include <cstdlib>
+#include <deque>
+#include <iostream>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <set>
+#include <sstream>
+#include <string>
+#include <thread>
+
+#ifndef _WIN32
+#include <netinet/in.h>
+#include <arpa/inet.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+#endif
+
+#include "misc.h"
+#include "position.h"
+#include "search.h"
+#include "server.h"
+#include "thread.h"
+#include "uci.h"
+
+#ifdef _WIN32
+
+void Server::run(std::istream&) {
+  sync_cout << "info string The server mode needs POSIX sockets" << sync_endl;
+}
+
+#else
+
+using std::string;
+
+namespace {
+
+  // Options that change what all the sessions share, settable only before the
+  // 'server' command. The other options are kept per session.
+  const std::set<string, UCI::CaseInsensitiveLess> ServerWide = {
+      "Threads", "Threads per History", "Hash", "Clear Hash", "Pawn Hash",
+      "Pawn Hash Shared", "Mate Hash", "SyzygyPath", "Debug Log File", "UCI_Chess960" };
+
+#ifdef MSG_NOSIGNAL
+  constexpr int SendFlags = MSG_NOSIGNAL; // A closed client must not raise SIGPIPE
+#else
+  constexpr int SendFlags = 0;
+#endif
+
+  // SocketBuf is the output buffer of a session. A line is queued when the
+  // stream is flushed by std::endl, and sent by the writer thread of the buffer,
+  // so that a slow client never stalls the search. The output is dropped once
+  // the client has gone.
+
+  class SocketBuf : public std::streambuf {
+
+    int fd;
+    string buffer, queued;
+    bool done = false;
+    std::mutex mutex;
+    std::condition_variable cv;
+    std::thread writer;
+
+    void write_loop() {
+
+      std::unique_lock<std::mutex> lk(mutex);
+      bool gone = false;
+
+      while (cv.wait(lk, [&]{ return !queued.empty() || done; }), !queued.empty())
+      {
+          string text = std::move(queued);
+          queued.clear();
+          lk.unlock();
+
+          for (size_t sent = 0; !gone && sent < text.size(); )
+          {
+              ssize_t n = send(fd, text.data() + sent, text.size() - sent, SendFlags);
+              gone = n <= 0;
+              sent += gone ? 0 : size_t(n);
+          }
+
+          lk.lock();
+      }
+    }
+
+  public:
+    explicit SocketBuf(int s) : fd(s), writer(&SocketBuf::write_loop, this) {}
+   ~SocketBuf() { stop(); }
+
+    int overflow(int c) override {
+      if (c != EOF)
+          buffer += char(c);
+      return c;
+    }
+
+    int sync() override {
+      if (!buffer.empty())
+      {
+          std::lock_guard<std::mutex> lk(mutex);
+          queued += buffer;
+          cv.notify_one();
+      }
+      buffer.clear();
+      return 0;
+    }
+
+    // stop() sends what is queued and ends the writer, before the socket closes
+    void stop() {
+      {
+          std::lock_guard<std::mutex> lk(mutex);
+          done = true;
+          cv.notify_one();
+      }
+      if (writer.joinable())
+          writer.join();
+    }
+  };
+
+  // NullBuf discards the output of a preempted search
+  struct NullBuf : public std::streambuf {
+    int overflow(int c) override { return c; }
+  };
+
+
+  // Session is the state of one client: its position, the StateInfo list that
+  // goes with it, and the values of the options it has set. The session mutex
+  // guards them against the scheduler, which reads them to start a search.
+
+  struct Session {
+
+    explicit Session(int s) : fd(s), buf(s), out(&buf) {
+      std::istringstream is("startpos");
+      UCI::position(pos, is, states);
+    }
+
+   ~Session() { buf.stop(); close(fd); }
+
+    int fd;
+    SocketBuf buf;
+    std::ostream out;
+    std::mutex mutex;
+    Position pos;
+    StateListPtr states;
+    std::map<string, string, UCI::CaseInsensitiveLess> options;
+  };
+
+  struct Job {
+    std::shared_ptr<Session> session;
+    Search::LimitsType limits;
+    bool ponder;
+  };
+
+
+  // Scheduler gives the whole thread pool to one search at a time, in the order
+  // of the 'go' commands. The search limits, the timer and the stop flag are
+  // process wide in the search, so the sessions take turns rather than split
+  // the cores, and a search waits for those queued before it. With a quantum,
+  // an infinite or ponder search is preempted after that time when other
+  // sessions wait, and queued again: it restarts from the shared hash, but
+  // loses the rest of its search state.
+
+  class Scheduler {
+
+  public:
+    void run(int quantum);
+    size_t submit(const Job& job);
+    void stop(const Session* s);
+    void ponderhit(const Session* s);
+    void close(const Session* s);
+    bool busy(const Session* s);
+
+  private:
+    std::mutex mutex;
+    std::condition_variable cv;
+    std::deque<Job> queue;
+    const Session* current = nullptr;
+    bool preempted = false, stopped = false, closed = false;
+  };
+
+  Scheduler Sched;
+  std::mutex OptionsMutex; // Options are changed by the scheduler between searches
+
+
+  // A search stopped while queued still has to answer with a best move
+  void shorten(Job& job) {
+
+    Search::LimitsType limits;
+    limits.startTime = now();
+    limits.searchmoves = job.limits.searchmoves;
+    limits.depth = 1;
+
+    job.limits = limits;
+    job.ponder = false;
+  }
+
+  // Scheduler::submit() queues a search and returns the number of searches
+  // that go before it.
+
+  size_t Scheduler::submit(const Job& job) {
+
+    std::unique_lock<std::mutex> lk(mutex);
+    size_t ahead = queue.size() + (current != nullptr);
+    queue.push_back(job);
+    cv.notify_one();
+    return ahead;
+  }
+
+  bool Scheduler::busy(const Session* s) {
+
+    std::unique_lock<std::mutex> lk(mutex);
+    return current == s || std::any_of(queue.begin(), queue.end(),
+                                       [&](const Job& j) { return j.session.get() == s; });
+  }
+
+  void Scheduler::stop(const Session* s) {
+
+    std::unique_lock<std::mutex> lk(mutex);
+
+    if (current == s)
+    {
+        stopped = true;
+        if (!preempted)
+            Threads.stop = true;
+    }
+
+    for (auto it = queue.begin(); it != queue.end(); ++it)
+        if (it->session.get() == s)
+        {
+            Job job = *it;
+            shorten(job);
+            queue.erase(it);
+            queue.push_front(job);
+            break;
+        }
+  }
+
+  void Scheduler::ponderhit(const Session* s) {
+
+    std::unique_lock<std::mutex> lk(mutex);
+
+    if (current == s)
+        Threads.main()->ponder = false;
+
+    for (Job& job : queue)
+        if (job.session.get() == s)
+            job.ponder = false;
+  }
+
+  void Scheduler::close(const Session* s) {
+
+    std::unique_lock<std::mutex> lk(mutex);
+
+    if (current == s)
+        closed = true, Threads.stop = true;
+
+    queue.erase(std::remove_if(queue.begin(), queue.end(),
+                               [&](const Job& j) { return j.session.get() == s; }),
+                queue.end());
+  }
+
+
+  // Scheduler::run() is the loop of the scheduler thread. It applies the options
+  // of the session, sends the search output to its socket, and gives the states
+  // back to the session when the search is over.
+
+  void Scheduler::run(int quantum) {
+
+    std::streambuf* console = std::cout.rdbuf();
+    NullBuf nullBuf;
+
+    while (true)
+    {
+        Job job;
+        {
+            std::unique_lock<std::mutex> lk(mutex);
+            cv.wait(lk, [&]{ return !queue.empty(); });
+
+            job = queue.front();
+            queue.pop_front();
+            current = job.session.get();
+            preempted = stopped = closed = false;
+        }
+
+        Session& s = *job.session;
+        std::map<string, string> saved;
+
+        {
+            std::unique_lock<std::mutex> lk(s.mutex);
+            {
+                std::unique_lock<std::mutex> olk(OptionsMutex);
+                for (const auto& o : s.options)
+                {
+                    saved.emplace(o.first, string(Options[o.first]));
+                    Options[o.first] = o.second;
+                }
+            }
+
+            std::cout << IO_LOCK;
+            std::cout.rdbuf(&s.buf);
+            std::cout << IO_UNLOCK;
+
+            job.limits.startTime = now();
+            Threads.start_thinking(s.pos, s.states, job.limits, job.ponder);
+        }
+
+        {
+            // A 'stop' received before the search started must not be lost
+            std::unique_lock<std::mutex> lk(mutex);
+            if (stopped || closed)
+                Threads.stop = true;
+        }
+
+        while (!Threads.main()->wait_for_search_finished(10))
+        {
+            std::unique_lock<std::mutex> lk(mutex);
+
+            if (   quantum > 0
+                && !preempted && !Threads.stop && !queue.empty()
+                && (job.limits.infinite || Threads.main()->ponder)
+                && now() - job.limits.startTime >= quantum)
+            {
+                preempted = true;
+
+                std::cout << IO_LOCK;
+                std::cout.rdbuf(&nullBuf);
+                std::cout << IO_UNLOCK;
+
+                Threads.stop = true;
+            }
+        }
+
+        {
+            std::unique_lock<std::mutex> lk(s.mutex);
+
+            if (!s.states) // Unless a new position came during the search
+                s.states = std::move(Threads.setup_states());
+
+            std::unique_lock<std::mutex> olk(OptionsMutex);
+            for (const auto& o : saved)
+                Options[o.first] = o.second;
+        }
+
+        std::cout << IO_LOCK;
+        std::cout.rdbuf(console);
+        std::cout << IO_UNLOCK;
+
+        std::unique_lock<std::mutex> lk(mutex);
+        current = nullptr;
+
+        if (preempted && !closed)
+        {
+            job.ponder = Threads.main()->ponder;
+            if (stopped)
+                shorten(job);
+            queue.push_back(job);
+        }
+    }
+  }
+
+
+  // session() reads the UCI commands of a client until it quits or goes away.
+  // The commands which only read or set the session state are answered here,
+  // the searches go through the scheduler.
+
+  void session(int fd) {
+
+    auto s = std::make_shared<Session>(fd);
+    string pending, cmd, token;
+    char chunk[4096];
+
+    auto reply = [&](const string& text) {
+        s->out << IO_LOCK << text << std::endl << IO_UNLOCK;
+    };
+
+    while (true)
+    {
+        size_t eol = pending.find('\n');
+
+        if (eol == string::npos)
+        {
+            ssize_t n = recv(fd, chunk, sizeof(chunk), 0);
+            if (n <= 0)
+                break;
+
+            pending.append(chunk, size_t(n));
+            continue;
+        }
+
+        cmd = pending.substr(0, eol);
+        pending.erase(0, eol + 1);
+
+        std::istringstream is(cmd);
+        token.clear();
+        is >> std::skipws >> token;
+
+        if (token == "quit")
+            break;
+
+        else if (token == "stop")      Sched.stop(s.get());
+        else if (token == "ponderhit") Sched.ponderhit(s.get());
+        else if (token == "isready")   reply("readyok");
+        else if (token == "ucinewgame") {} // The hash is shared, keep it
+
+        else if (token == "uci")
+        {
+            std::unique_lock<std::mutex> lk(OptionsMutex);
+            std::stringstream ss;
+            ss << "id name " << engine_info(true) << "\n" << Options << "\nuciok";
+            reply(ss.str());
+        }
+
+        else if (token == "setoption")
+        {
+            string name, value;
+            is >> token; // Consume "name" token
+
+            while (is >> token && token != "value")
+                name += (name.empty() ? "" : " ") + token;
+
+            while (is >> token)
+                value += (value.empty() ? "" : " ") + token;
+
+            if (!Options.count(name))
+                reply("No such option: " + name);
+
+            else if (ServerWide.count(name))
+                reply("info string " + name + " is set for the whole server");
+            else
+            {
+                std::unique_lock<std::mutex> lk(s->mutex);
+                s->options[name] = value;
+            }
+        }
+
+        else if (token == "position")
+        {
+            std::unique_lock<std::mutex> lk(s->mutex);
+            UCI::position(s->pos, is, s->states);
+        }
+
+        else if (token == "go")
+        {
+            if (Sched.busy(s.get()))
+            {
+                reply("info string A search is already running");
+                continue;
+            }
+
+            Job job;
+            job.session = s;
+            job.ponder = false;
+            {
+                std::unique_lock<std::mutex> lk(s->mutex);
+                job.limits = UCI::limits(s->pos, is, job.ponder);
+            }
+            size_t ahead = Sched.submit(job);
+
+            if (ahead)
+                reply("info string Queued behind " + std::to_string(ahead) + " searches");
+        }
+
+        else if (token == "d")
+        {
+            std::unique_lock<std::mutex> lk(s->mutex);
+            std::stringstream ss;
+            ss << s->pos;
+            reply(ss.str());
+        }
+
+        else if (!token.empty())
+            reply("Unknown command: " + cmd);
+    }
+
+    Sched.close(s.get());
+  }
+
+} // namespace
+
+
+/// Server::run() listens on a TCP port or a Unix socket and serves each client
+/// as a UCI session with its own position and options, started by the 'server'
+/// command:
+///
+/// server tcp <port> [address] [quantum <ms>]
+/// server unix <path> [quantum <ms>]
+///
+/// All the sessions share the transposition table, the tablebases and the
+/// threads, set with the usual options before 'server'. The searches do not
+/// run side by side on separate cores: each one gets all the threads in turn,
+/// so a session waits for the searches queued before its own. Run one engine
+/// per client when the searches must be concurrent. The TCP address is the
+/// loopback one by default. Without a quantum an infinite analysis keeps the
+/// threads until 'stop'. With one, it gives them to a waiting session after
+/// that many milliseconds, and restarts later from the shared hash.
+
+void Server::run(std::istream& args) {
+
+  string kind, where, token, address = "127.0.0.1";
+  int quantum = 0, fd = -1;
+
+  args >> kind >> where;
+
+  while (args >> token)
+      if (token == "quantum")
+          args >> quantum;
+      else
+          address = token;
+
+  char* end = nullptr;
+  long port = std::strtol(where.c_str(), &end, 10);
+
+  if (kind == "tcp" && !where.empty() && !*end && port > 0 && port <= 65535)
+  {
+      sockaddr_in addr = {};
+      addr.sin_family = AF_INET;
+      addr.sin_port = htons(uint16_t(port));
+      int yes = 1;
+
+      if (   inet_pton(AF_INET, address.c_str(), &addr.sin_addr) == 1
+          && (fd = socket(AF_INET, SOCK_STREAM, 0)) >= 0)
+      {
+          setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &yes, sizeof(yes));
+
+          if (bind(fd, (sockaddr*)&addr, sizeof(addr)))
+              ::close(fd), fd = -1;
+      }
+  }
+  else if (kind == "unix" && where.size() < sizeof(sockaddr_un::sun_path))
+  {
+      sockaddr_un addr = {};
+      addr.sun_family = AF_UNIX;
+      where.copy(addr.sun_path, where.size());
+      unlink(where.c_str());
+
+      if (   (fd = socket(AF_UNIX, SOCK_STREAM, 0)) >= 0
+          && bind(fd, (sockaddr*)&addr, sizeof(addr)))
+          ::close(fd), fd = -1;
+  }
+
+  if (fd < 0 || listen(fd, 64))
+  {
+      sync_cout << "info string Unable to listen on " << kind << " " << where << sync_endl;
+      return;
+  }
+
+  sync_cout << "info string Listening on " << kind << " " << where << sync_endl;
+
+  std::thread(&Scheduler::run, &Sched, quantum).detach();
+
+  for (int client; (client = accept(fd, nullptr, nullptr)) >= 0; )
+  {
+#ifdef SO_NOSIGPIPE
+      int yes = 1;
+      setsockopt(client, SOL_SOCKET, SO_NOSIGPIPE, &yes, sizeof(yes));
+#endif
+      std::thread(session, client).detach();
+  }
+}
+
+#endif
@@ -21,6 +21,8 @@
 #include <cassert>
 
 #include <algorithm> // For std::count
+#include <cstring>   // For std::memset
+#include <sstream>
 #include "movegen.h"
 #include "search.h"
 #include "thread.h"
@@ -62,23 +64,41 @@ int Thread::best_move_count(Move move) {
   return rm != rootMoves.begin() + pvLast ? rm->bestMoveCount : 0;
 }
 
-/// Thread::clear() reset histories, usually before a new game
+/// Thread::clear() reset histories, usually before a new game. A set of shared
+/// continuation histories is reset by the first thread of its group only.
 
 void Thread::clear() {
 
   counterMoves.fill(MOVE_NONE);
   mainHistory.fill(0);
   captureHistory.fill(0);
+  pawnsTable.hits = pawnsTable.misses = 0;
+#if !defined(USE_LEAN_TABLES)
+  materialEntry.key = 0;
+#endif
+
+#ifdef USE_STATS
+  std::memset(&stats, 0, sizeof(stats));
+#endif
+
+  if (ownedHistory)
+      ownedHistory->clear();
+}
+
+
+/// ContinuationTables::clear() resets a set of continuation histories
+
+void ContinuationTables::clear() {
 
   for (bool inCheck : { false, true })
     for (StatsType c : { NoCaptures, Captures })
-      for (auto& to : continuationHistory[inCheck][c])
+      for (auto& to : table[inCheck][c])
         for (auto& h : to)
           h->fill(0);
 
   for (bool inCheck : { false, true })
     for (StatsType c : { NoCaptures, Captures })
-      continuationHistory[inCheck][c][NO_PIECE][0]->fill(Search::CounterMovePruneThreshold - 1);
+      table[inCheck][c][NO_PIECE][0]->fill(Search::CounterMovePruneThreshold - 1);
 }
 
 /// Thread::start_searching() wakes up the thread that will start the search
@@ -91,6 +111,20 @@ void Thread::start_searching() {
 }
 
 
+/// Thread::start_job() wakes up the thread that will run the given function
+/// instead of a search, for instance clear() so that each thread resets its own
+/// data, first touching the pages from its own core. Completion is waited for
+/// with wait_for_search_finished().
+
+void Thread::start_job(std::function<void()> f) {
+
+  std::lock_guard<std::mutex> lk(mutex);
+  job = std::move(f);
+  searching = true;
+  cv.notify_one(); // Wake up the thread in idle_loop()
+}
+
+
 /// Thread::wait_for_search_finished() blocks on the condition variable
 /// until the thread has finished searching.
 
@@ -101,6 +135,16 @@ void Thread::wait_for_search_finished() {
 }
 
 
+/// Thread::wait_for_search_finished() with a timeout returns false if the thread
+/// is still searching after timeoutMs milliseconds.
+
+bool Thread::wait_for_search_finished(int timeoutMs) {
+
+  std::unique_lock<std::mutex> lk(mutex);
+  return cv.wait_for(lk, std::chrono::milliseconds(timeoutMs), [&]{ return !searching; });
+}
+
+
 /// Thread::idle_loop() is where the thread is parked, blocked on the
 /// condition variable, when it has no work to do.
 
@@ -124,9 +168,14 @@ void Thread::idle_loop() {
       if (exit)
           return;
 
+      std::function<void()> f = std::move(job);
+      job = nullptr;
       lk.unlock();
 
-      search();
+      if (f)
+          f();
+      else
+          search();
   }
 }
 
@@ -148,28 +197,79 @@ void ThreadPool::set(size_t requested) {
 
       while (size() < requested)
           push_back(new Thread(size()));
+
+      // One set of continuation histories per group of "Threads per History"
+      // consecutive threads.
+      const size_t groupSize = Options["Threads per History"];
+      histories.clear();
+
+      for (size_t i = 0; i < size(); ++i)
+      {
+          if (i % groupSize == 0)
+              histories.emplace_back(new ContinuationTables);
+
+          at(i)->continuationHistory = histories.back()->table;
+          at(i)->ownedHistory = i % groupSize == 0 ? histories.back().get() : nullptr;
+      }
+
       clear();
 
+      memory_footprint("Thread data", sizeof(MainThread) + (size() - 1) * sizeof(Thread));
+      memory_footprint("Continuation history", histories.size() * sizeof(ContinuationTables));
+#if defined(USE_LEAN_TABLES)
+      memory_footprint("Material table", size() * Material::TableSize * sizeof(Material::Entry));
+#endif
+
       // Reallocate the hash with the new threadpool size
       TT.resize(Options["Hash"]);
 
+      // Reallocate the pawn hash tables, one per new thread or a shared one
+      Pawns::resize();
+
       // Init thread number dependent search params.
       Search::init();
   }
 }
 
-/// ThreadPool::clear() sets threadPool data to initial values.
+/// ThreadPool::clear() sets threadPool data to initial values. All the threads
+/// reset their data in parallel.
 
 void ThreadPool::clear() {
 
   for (Thread* th : *this)
-      th->clear();
+      th->start_job([th]() { th->clear(); });
+
+  for (Thread* th : *this)
+      th->wait_for_search_finished();
 
   main()->callsCnt = 0;
   main()->previousScore = VALUE_INFINITE;
   main()->previousTimeReduction = 1.0;
 }
 
+/// ThreadPool::footprint() reports the memory used on average by each thread,
+/// counting its share of the continuation histories and of the pawn hash.
+
+const std::string ThreadPool::footprint() const {
+
+  const size_t threads = size();
+  const size_t pawnHash = Pawns::footprint();
+  const size_t histBytes = histories.size() * sizeof(ContinuationTables);
+  const size_t own = (sizeof(MainThread) + (threads - 1) * sizeof(Thread)) / threads;
+
+  std::stringstream ss;
+
+  ss << "Threads              : " << threads << " in " << histories.size()
+     << " continuation history set(s)"
+     << "\nPer thread, own data : " << own << " bytes"
+     << "\nPer thread, histories: " << histBytes / threads << " bytes"
+     << "\nPer thread, pawn hash: " << pawnHash / threads << " bytes"
+     << "\nPer thread, total    : " << own + (histBytes + pawnHash) / threads << " bytes";
+
+  return ss.str();
+}
+
+
 /// ThreadPool::start_thinking() wakes up main thread waiting in idle_loop() and
 /// returns immediately. Main thread will wake up other threads and start the search.
 
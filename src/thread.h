@@ -23,7 +23,10 @@
 
 #include <atomic>
 #include <condition_variable>
+#include <functional>
+#include <memory>
 #include <mutex>
+#include <string>
 #include <thread>
 #include <vector>
 
@@ -35,10 +38,48 @@
 #include "thread_win32_osx.h"
 
 
+/// ContinuationTables holds the continuation histories indexed by [inCheck]
+/// [captureOrPromotion]. At about 8 MB they are most of the memory of a thread,
+/// so they live outside of it and a group of threads can share one set, as set
+/// by the "Threads per History" option. Updates from the group are racy, like
+/// the ones of the transposition table.
+
+struct ContinuationTables {
+
+  void clear();
+
+  ContinuationHistory table[2][2];
+};
+
+
+/// ThreadCounter is a statistic written by its own thread and read by the others.
+/// With a single search thread it needs no atomic operations.
+
+#ifdef SINGLE_THREAD
+constexpr bool SingleThread = true;
+
+struct ThreadCounter {
+  ThreadCounter& operator=(uint64_t v) { value = v; return *this; }
+  ThreadCounter& operator++() { ++value; return *this; }
+  operator uint64_t() const { return value; }
+  uint64_t load(std::memory_order) const { return value; }
+  uint64_t fetch_add(uint64_t v, std::memory_order) { return (value += v) - v; }
+
+  uint64_t value;
+};
+#else
+constexpr bool SingleThread = false;
+typedef std::atomic<uint64_t> ThreadCounter;
+#endif
+
+
 /// Thread class keeps together all the thread-related stuff. We use
-/// per-thread pawn and material hash tables so that once we get a
-/// pointer to an entry its life time is unlimited and we don't have
-/// to care about someone changing the entry under our feet.
+/// per-thread pawn hash tables so that once we get a pointer to an
+/// entry its life time is unlimited and we don't have to care about
+/// someone changing the entry under our feet. When the pawn hash is
+/// shared, the entry is copied into the thread's table. The material
+/// table is read-only, except for the rare material configurations
+/// out of its range, which are computed into a per-thread entry.
 
 class Thread {
 
@@ -46,6 +87,7 @@ class Thread {
   std::condition_variable cv;
   size_t idx;
   bool exit = false, searching = true; // Set before starting std::thread
+  std::function<void()> job;
   NativeThread stdThread;
 
 public:
@@ -55,16 +97,22 @@ public:
   void clear();
   void idle_loop();
   void start_searching();
+  void start_job(std::function<void()> f);
   void wait_for_search_finished();
+  bool wait_for_search_finished(int timeoutMs);
   int best_move_count(Move move);
 
   Pawns::Table pawnsTable;
+#if defined(USE_LEAN_TABLES)
   Material::Table materialTable;
+#else
+  Material::Entry materialEntry;
+#endif
   size_t pvIdx, pvLast;
   uint64_t ttHitAverage;
   int selDepth, nmpMinPly;
   Color nmpColor;
-  std::atomic<uint64_t> nodes, tbHits, bestMoveChanges;
+  ThreadCounter nodes, tbHits, bestMoveChanges;
 
   Position rootPos;
   Search::RootMoves rootMoves;
@@ -72,8 +120,12 @@ public:
   CounterMoveHistory counterMoves;
   ButterflyHistory mainHistory;
   CapturePieceToHistory captureHistory;
-  ContinuationHistory continuationHistory[2][2];
+  ContinuationHistory (*continuationHistory)[2];
+  ContinuationTables* ownedHistory; // Set on the thread that clears a shared set
   Score contempt;
+#ifdef USE_STATS
+  Search::SearchStats stats;
+#endif
 };
 
 
@@ -92,6 +144,8 @@ struct MainThread : public Thread {
   int callsCnt;
   bool stopOnPonderhit;
   std::atomic_bool ponder;
+  TimePoint infoInterval, nextInfo, nextCurrmove; // Info rate limit, as elapsed times
+  bool infoHeld; // The last PV info was not sent
 };
 
 
@@ -104,17 +158,21 @@ struct ThreadPool : public std::vector<Thread*> {
   void start_thinking(Position&, StateListPtr&, const Search::LimitsType&, bool = false);
   void clear();
   void set(size_t);
+  const std::string footprint() const;
 
   MainThread* main()        const { return static_cast<MainThread*>(front()); }
   uint64_t nodes_searched() const { return accumulate(&Thread::nodes); }
   uint64_t tb_hits()        const { return accumulate(&Thread::tbHits); }
+  StateListPtr& setup_states()    { return setupStates; }
 
   std::atomic_bool stop, increaseDepth;
+  bool selfPlay = false; // Each thread searches its own games, with no main thread
 
 private:
   StateListPtr setupStates;
+  std::vector<std::unique_ptr<ContinuationTables>> histories;
 
-  uint64_t accumulate(std::atomic<uint64_t> Thread::* member) const {
+  uint64_t accumulate(ThreadCounter Thread::* member) const {
 
     uint64_t sum = 0;
     for (Thread* th : *this)
@@ -23,6 +23,7 @@
 #include <thread>
 
 #include "bitboard.h"
+#include "cluster.h"
 #include "misc.h"
 #include "thread.h"
 #include "tt.h"
@@ -51,6 +52,9 @@ void TTEntry::save(Key k, Value v, bool pv, Bound b, Depth d, Move m, Value ev)
       eval16    = (int16_t)ev;
       genBound8 = (uint8_t)(TT.generation8 | uint8_t(pv) << 2 | b);
       depth8    = (uint8_t)(d - DEPTH_OFFSET);
+
+      if (Cluster::Active && d >= Cluster::ShareDepth)
+          Cluster::share(k, *this);
   }
 }
 
@@ -58,6 +62,8 @@ void TTEntry::save(Key k, Value v, bool pv, Bound b, Depth d, Move m, Value ev)
 /// TranspositionTable::resize() sets the size of the transposition table,
 /// measured in megabytes. Transposition table consists of a power of 2 number
 /// of clusters and each cluster consists of ClusterSize number of TTEntry.
+/// The new table is zeroed lazily by the OS on first access, which avoids
+/// touching the whole table at startup.
 
 void TranspositionTable::resize(size_t mbSize) {
 
@@ -66,7 +72,7 @@ void TranspositionTable::resize(size_t mbSize) {
   clusterCount = mbSize * 1024 * 1024 / sizeof(Cluster);
 
   free(mem);
-  mem = malloc(clusterCount * sizeof(Cluster) + CacheLineSize - 1);
+  mem = calloc(clusterCount * sizeof(Cluster) + CacheLineSize - 1, 1);
 
   if (!mem)
   {
@@ -76,7 +82,8 @@ void TranspositionTable::resize(size_t mbSize) {
   }
 
   table = (Cluster*)((uintptr_t(mem) + CacheLineSize - 1) & ~(CacheLineSize - 1));
-  clear();
+
+  memory_footprint("Transposition table", clusterCount * sizeof(Cluster));
 }
 
 
@@ -37,6 +37,26 @@
 ///
 /// -DUSE_PEXT    | Add runtime support for use of pext asm-instruction. Works
 ///               | only in 64-bit mode and requires hardware with pext support.
+///
+/// -DUSE_AVX512  | Serialize move lists with AVX-512 VBMI2 byte compression.
+///               | Requires hardware with AVX-512 F, BW and VBMI2 support.
+///
+/// -DUSE_COMPACT_MAGICS | Store slider attacks as one byte per magic index into
+///               | a list of the distinct attacks of each square.
+///
+/// -DUSE_PDEP_MAGICS | Store slider attacks as 16-bit words, expanded with pdep.
+///               | Requires USE_PEXT.
+///
+/// -DUSE_LEAN_TABLES | Compute square distances, lines and popcounts on demand
+///               | instead of keeping them in tables, hash the material entries
+///               | per thread and leave out the KBPK, KRKP and KQKP bitbases.
+///
+/// -DUSE_STATS   | Count how often each pruning and extension step of the search
+///               | fires, shown by the 'stats' command, and collect the Dbg probes
+///               | shown by the 'dbgstats' command. Slower, for tuning only.
+///
+/// -DSINGLE_THREAD | Search with one thread only. Its counters are not atomic,
+///               | and the code that only matters with helper threads is gone.
 
 #include <cassert>
 #include <cctype>
@@ -74,10 +94,16 @@
 #endif
 
 #if defined(USE_PEXT)
-#  include <immintrin.h> // Header for _pext_u64() intrinsic
+#  include <immintrin.h> // Header for _pext_u64() and _pdep_u64() intrinsics
 #  define pext(b, m) _pext_u64(b, m)
+#  define pdep(b, m) _pdep_u64(b, m)
 #else
 #  define pext(b, m) 0
+#  define pdep(b, m) 0
+#endif
+
+#if defined(USE_PDEP_MAGICS) && !defined(USE_PEXT)
+#  error "USE_PDEP_MAGICS requires USE_PEXT"
 #endif
 
 #ifdef USE_POPCNT
@@ -92,6 +118,12 @@ constexpr bool HasPext = true;
 constexpr bool HasPext = false;
 #endif
 
+#ifdef USE_AVX512
+constexpr bool HasAvx512 = true;
+#else
+constexpr bool HasAvx512 = false;
+#endif
+
 #ifdef IS_64BIT
 constexpr bool Is64Bit = true;
 #else
@@ -18,15 +18,26 @@
   along with this program.  If not, see <http://www.gnu.org/licenses/>.
 */
 
+#include <algorithm>
 #include <cassert>
+#include <cmath>
+#include <chrono>
+#include <fstream>
+#include <iomanip>
 #include <iostream>
+#include <iterator>
+#include <numeric>
 #include <sstream>
 #include <string>
 
+#include "cluster.h"
 #include "evaluate.h"
 #include "movegen.h"
+#include "pawns.h"
+#include "pgn.h"
 #include "position.h"
 #include "search.h"
+#include "server.h"
 #include "thread.h"
 #include "timeman.h"
 #include "tt.h"
@@ -36,6 +47,7 @@
 using namespace std;
 
 extern vector<string> setup_bench(const Position&, istream&);
+extern void gensfen(istream&);
 
 namespace {
 
@@ -43,41 +55,6 @@ namespace {
   const char* StartFEN = "rnbqkbnr/pppppppp/8/8/8/8/PPPPPPPP/RNBQKBNR w KQkq - 0 1";
 
 
-  // position() is called when engine receives the "position" UCI command.
-  // The function sets up the position described in the given FEN string ("fen")
-  // or the starting position ("startpos") and then makes the moves given in the
-  // following move list ("moves").
-
-  void position(Position& pos, istringstream& is, StateListPtr& states) {
-
-    Move m;
-    string token, fen;
-
-    is >> token;
-
-    if (token == "startpos")
-    {
-        fen = StartFEN;
-        is >> token; // Consume "moves" token if any
-    }
-    else if (token == "fen")
-        while (is >> token && token != "moves")
-            fen += token + " ";
-    else
-        return;
-
-    states = StateListPtr(new std::deque<StateInfo>(1)); // Drop old and create a new one
-    pos.set(fen, Options["UCI_Chess960"], &states->back(), Threads.main());
-
-    // Parse move list (if any)
-    while (is >> token && (m = UCI::to_move(pos, token)) != MOVE_NONE)
-    {
-        states->emplace_back();
-        pos.do_move(m, states->back());
-    }
-  }
-
-
   // setoption() is called when engine receives the "setoption" UCI command. The
   // function updates the UCI option ("name") to the given value ("value").
 
@@ -108,29 +85,8 @@ namespace {
 
   void go(Position& pos, istringstream& is, StateListPtr& states) {
 
-    Search::LimitsType limits;
-    string token;
     bool ponderMode = false;
-
-    limits.startTime = now(); // As early as possible!
-
-    while (is >> token)
-        if (token == "searchmoves")
-            while (is >> token)
-                limits.searchmoves.push_back(UCI::to_move(pos, token));
-
-        else if (token == "wtime")     is >> limits.time[WHITE];
-        else if (token == "btime")     is >> limits.time[BLACK];
-        else if (token == "winc")      is >> limits.inc[WHITE];
-        else if (token == "binc")      is >> limits.inc[BLACK];
-        else if (token == "movestogo") is >> limits.movestogo;
-        else if (token == "depth")     is >> limits.depth;
-        else if (token == "nodes")     is >> limits.nodes;
-        else if (token == "movetime")  is >> limits.movetime;
-        else if (token == "mate")      is >> limits.mate;
-        else if (token == "perft")     is >> limits.perft;
-        else if (token == "infinite")  limits.infinite = 1;
-        else if (token == "ponder")    ponderMode = true;
+    Search::LimitsType limits = UCI::limits(pos, is, ponderMode);
 
     Threads.start_thinking(pos, states, limits, ponderMode);
   }
@@ -168,7 +124,7 @@ namespace {
                sync_cout << "\n" << Eval::trace(pos) << sync_endl;
         }
         else if (token == "setoption")  setoption(is);
-        else if (token == "position")   position(pos, is, states);
+        else if (token == "position")   UCI::position(pos, is, states);
         else if (token == "ucinewgame") { Search::clear(); elapsed = now(); } // Search::clear() may take some while
     }
 
@@ -182,6 +138,535 @@ namespace {
          << "\nNodes/second    : " << 1000 * nodes / elapsed << endl;
   }
 
+  // Statistics of a list of samples, used by perfbench()
+
+  double median(vector<double> v) {
+    sort(v.begin(), v.end());
+    return v.empty() ? 0 : v.size() % 2 ? v[v.size() / 2] : (v[v.size() / 2 - 1] + v[v.size() / 2]) / 2;
+  }
+
+  double mean(const vector<double>& v) {
+    return v.empty() ? 0 : accumulate(v.begin(), v.end(), 0.0) / v.size();
+  }
+
+  double stddev(const vector<double>& v) {
+    double m = mean(v), sq = 0;
+    for (double x : v)
+        sq += (x - m) * (x - m);
+    return v.size() > 1 ? sqrt(sq / (v.size() - 1)) : 0;
+  }
+
+  // json_number() returns the number following the first "key": of a JSON text
+  // after the given section, enough to read back a previous perfbench report.
+
+  double json_number(const string& json, const string& key, const string& section = "") {
+    size_t i = json.find("\"" + key + "\":", section.empty() ? 0 : json.find("\"" + section + "\""));
+    return i == string::npos ? 0 : atof(json.c_str() + i + key.size() + 3);
+  }
+
+
+  // perfbench() is a bench for performance regression testing. It runs the
+  // bench positions 'runs' times after 'warmup' unmeasured runs, and reports
+  // as JSON the median and standard deviation of the nps for each position and
+  // in aggregate, the time to reach the completed depth, the TT hashfull and
+  // the bench signature. Given a baseline report, it also gives the speedup
+  // with a t statistic, so that only significant changes fail a gate. The
+  // bench arguments follow the "bench" token:
+  //
+  // perfbench runs 10 warmup 1 output new.json baseline old.json bench 16 1 13
+
+  void perfbench(Position& pos, istream& args, StateListPtr& states) {
+
+    typedef std::chrono::steady_clock Clock;
+
+    struct Sample {
+      uint64_t nodes;
+      double ms;
+      int depth, hashfull;
+    };
+
+    int runs = 5, warmup = 1;
+    string token, baseline, output;
+
+    while (args >> token && token != "bench")
+        if (token == "runs")          args >> runs;
+        else if (token == "warmup")   args >> warmup;
+        else if (token == "baseline") args >> baseline;
+        else if (token == "output")   args >> output;
+
+    runs = max(runs, 1);
+    vector<string> list = setup_bench(pos, args);
+    vector<vector<Sample>> samples; // [run][position]
+
+    for (int r = 0; r < warmup + runs; ++r)
+    {
+        vector<Sample> run;
+
+        cerr << "\nRun " << r + 1 << '/' << warmup + runs << (r < warmup ? " (warmup)" : "") << endl;
+
+        for (const auto& cmd : list)
+        {
+            istringstream is(cmd);
+            is >> skipws >> token;
+
+            if (token == "go")
+            {
+                Clock::time_point start = Clock::now();
+                go(pos, is, states);
+                Threads.main()->wait_for_search_finished();
+                double ms = std::chrono::duration<double, std::milli>(Clock::now() - start).count();
+                run.push_back({ Threads.nodes_searched(), ms, Threads.main()->completedDepth, TT.hashfull() });
+            }
+            else if (token == "setoption")  setoption(is);
+            else if (token == "position")   UCI::position(pos, is, states);
+            else if (token == "ucinewgame") Search::clear();
+        }
+
+        if (r >= warmup)
+            samples.push_back(run);
+    }
+
+    // Per position and aggregate statistics over the measured runs
+    size_t n = samples[0].size();
+    vector<double> runNps, runMs;
+    uint64_t signature = 0;
+    bool deterministic = true;
+
+    for (const Sample& sm : samples[0])
+        signature += sm.nodes;
+
+    for (const auto& run : samples)
+    {
+        uint64_t nodes = 0;
+        double ms = 0;
+
+        for (const Sample& sm : run)
+            nodes += sm.nodes, ms += sm.ms;
+
+        deterministic &= nodes == signature;
+        runNps.push_back(1000 * nodes / max(ms, 0.001));
+        runMs.push_back(ms);
+    }
+
+    std::stringstream ss;
+    ss << fixed << setprecision(1)
+       << "{\n  \"engine\": \"" << engine_info() << "\","
+       << "\n  \"threads\": " << Threads.size() << ","
+       << "\n  \"hash\": " << int(Options["Hash"]) << ","
+       << "\n  \"runs\": " << runs << ","
+       << "\n  \"warmup\": " << warmup << ","
+       << "\n  \"signature\": " << signature << ","
+       << "\n  \"deterministic\": " << (deterministic ? "true" : "false") << ","
+       << "\n  \"positions\": [";
+
+    for (size_t i = 0; i < n; ++i)
+    {
+        vector<double> nps, ms;
+
+        for (const auto& run : samples)
+        {
+            ms.push_back(run[i].ms);
+            nps.push_back(1000 * run[i].nodes / max(run[i].ms, 0.001));
+        }
+
+        ss << (i ? "," : "") << "\n    { \"index\": " << i + 1
+           << ", \"nodes\": " << samples[0][i].nodes
+           << ", \"depth\": " << samples[0][i].depth
+           << ", \"time_to_depth_ms\": " << median(ms)
+           << ", \"nps_median\": " << median(nps)
+           << ", \"nps_stddev\": " << stddev(nps)
+           << ", \"hashfull\": " << samples[0][i].hashfull << " }";
+    }
+
+    ss << "\n  ],"
+       << "\n  \"aggregate\": { \"nodes\": " << signature
+       << ", \"time_ms_median\": " << median(runMs)
+       << ", \"nps_median\": " << median(runNps)
+       << ", \"nps_mean\": " << mean(runNps)
+       << ", \"nps_stddev\": " << stddev(runNps)
+       << ", \"nps_min\": " << *min_element(runNps.begin(), runNps.end())
+       << ", \"nps_max\": " << *max_element(runNps.begin(), runNps.end()) << " }";
+
+    if (!baseline.empty())
+    {
+        ifstream file(baseline);
+        string json((istreambuf_iterator<char>(file)), istreambuf_iterator<char>());
+
+        if (json.empty())
+            cerr << "Unable to read baseline " << baseline << endl;
+        else
+        {
+            // Welch's t statistic of the difference of the mean nps of the runs
+            double baseMean = json_number(json, "nps_mean", "aggregate");
+            double baseSd   = json_number(json, "nps_stddev", "aggregate");
+            double baseRuns = max(json_number(json, "runs"), 1.0);
+            double se = sqrt(baseSd * baseSd / baseRuns + stddev(runNps) * stddev(runNps) / runs);
+            double t = se > 0 ? (mean(runNps) - baseMean) / se : 0;
+
+            ss << ",\n  \"baseline\": { \"file\": \"" << baseline << "\""
+               << ", \"nps_median\": " << json_number(json, "nps_median", "aggregate")
+               << ", \"speedup_percent\": " << setprecision(2)
+               << 100 * (median(runNps) / max(json_number(json, "nps_median", "aggregate"), 1.0) - 1)
+               << ", \"t\": " << t
+               << ", \"significant\": " << (fabs(t) > 2 ? "true" : "false")
+               << ", \"signature_match\": "
+               << (uint64_t(json_number(json, "signature")) == signature ? "true" : "false") << " }";
+        }
+    }
+
+    ss << "\n}\n";
+
+    if (output.empty())
+        sync_cout << ss.str() << sync_endl;
+    else
+        ofstream(output) << ss.str();
+
+    cerr << "\n==========================="
+         << "\nRuns            : " << runs
+         << "\nNodes searched  : " << signature
+         << "\nNodes/second    : " << size_t(median(runNps)) << " (median), "
+         << size_t(stddev(runNps)) << " (stddev)" << endl;
+  }
+
+  // InfoReader takes the place of the std::cout buffer during an epd search.
+  // It reads the search output as a GUI would: the depth, time and first move
+  // of each "info" line with a PV of the first line, and the final best move.
+
+  struct InfoReader : public streambuf {
+
+    struct Iteration {
+      int depth;
+      TimePoint time;
+      string move;
+    };
+
+    int overflow(int c) override {
+
+      if (c != '\n')
+          return line += char(c), c;
+
+      istringstream is(line);
+      string token;
+      Iteration it = { 0, 0, "" };
+      int multiPV = 1;
+      bool bound = false;
+
+      while (is >> token)
+          if (token == "depth")          is >> it.depth;
+          else if (token == "time")      is >> it.time;
+          else if (token == "multipv")   is >> multiPV;
+          else if (token == "bestmove")  is >> bestMove;
+          else if (token == "pv")       { is >> it.move; break; }
+          else bound |= token == "lowerbound" || token == "upperbound";
+
+      if (!it.move.empty() && multiPV == 1 && !bound)
+          iterations.push_back(it);
+
+      line.clear();
+      return c;
+    }
+
+    string line, bestMove;
+    vector<Iteration> iterations;
+  };
+
+
+  // epd() runs a test suite of EPD records, whose "bm" (best moves), "am"
+  // (avoid moves) and "id" operations are read, with the given limit on each
+  // position after a 'ucinewgame'. A position is solved when the final best
+  // move is correct, and its solve time and depth are those of the iteration from
+  // which the search held a correct move until the end. For example:
+  //
+  // epd wac.epd movetime 1000 threads 4 hash 64
+
+  void epd(Position& pos, istream& args, StateListPtr& states) {
+
+    struct Record {
+      string fen, id;
+      vector<string> bm, am;
+    };
+
+    string file, token, limit = "movetime 1000";
+    args >> file;
+
+    while (args >> token)
+        if (token == "threads" || token == "hash")
+        {
+            string value;
+            args >> value;
+            istringstream is("name " + string(token == "hash" ? "Hash" : "Threads") + " value " + value);
+            setoption(is);
+        }
+        else if (token == "movetime" || token == "nodes" || token == "depth")
+        {
+            string value;
+            args >> value;
+            limit = token + " " + value;
+        }
+
+    ifstream in(file);
+    if (!in.is_open())
+    {
+        cerr << "Unable to open file " << file << endl;
+        return;
+    }
+
+    // The four FEN fields are followed by the operations, each one an opcode
+    // and its operands up to a semicolon. The move counters are optional.
+    vector<Record> records;
+    string line;
+
+    while (getline(in, line))
+    {
+        istringstream is(line);
+        Record r;
+
+        for (int i = 0; i < 4 && is >> token; ++i)
+            r.fen += token + " ";
+
+        if (r.fen.empty())
+            continue;
+
+        string ops((istreambuf_iterator<char>(is)), istreambuf_iterator<char>());
+        istringstream counters(ops);
+        int hmvc, fmvn;
+
+        if (counters >> hmvc >> fmvn)
+        {
+            r.fen += to_string(hmvc) + " " + to_string(fmvn);
+            ops.erase(0, counters.eof() ? string::npos : size_t(counters.tellg()));
+        }
+        else
+            r.fen += "0 1";
+
+        istringstream opStream(ops);
+        string op;
+
+        while (getline(opStream, op, ';'))
+        {
+            istringstream os(op);
+            string opcode, operand;
+            os >> opcode;
+
+            while (os >> operand)
+                if (opcode == "bm")      r.bm.push_back(operand);
+                else if (opcode == "am") r.am.push_back(operand);
+                else if (opcode == "id") r.id += (r.id.empty() ? "" : " ") + operand;
+        }
+
+        r.id.erase(remove(r.id.begin(), r.id.end(), '"'), r.id.end());
+        records.push_back(r);
+    }
+
+    int solved = 0;
+    uint64_t nodes = 0;
+    TimePoint totalTime = 0, solveTime = 0;
+
+    for (size_t i = 0; i < records.size(); ++i)
+    {
+        const Record& r = records[i];
+
+        if (r.bm.empty() && r.am.empty())
+        {
+            cerr << setw(4) << i + 1 << '/' << records.size() << "  "
+                 << left << setw(16) << (r.id.empty() ? "-" : r.id) << right
+                 << "  error: no bm or am operation" << endl;
+            continue;
+        }
+
+        istringstream is("fen " + r.fen);
+        UCI::position(pos, is, states);
+
+        // Moves of the suite in SAN, compared in UCI notation with the output
+        auto to_uci = [&](const vector<string>& sans) {
+            vector<string> moves;
+            for (const string& san : sans)
+            {
+                Move m = PGN::to_move(pos, san);
+                if (m == MOVE_NONE)
+                    cerr << "Illegal move " << san << " in " << r.fen << endl;
+                moves.push_back(UCI::move(m, pos.is_chess960()));
+            }
+            return moves;
+        };
+
+        vector<string> bm = to_uci(r.bm), am = to_uci(r.am);
+        auto correct = [&](const string& move) {
+            return   (bm.empty() || find(bm.begin(), bm.end(), move) != bm.end())
+                  && find(am.begin(), am.end(), move) == am.end();
+        };
+
+        Search::clear();
+
+        InfoReader reader;
+        streambuf* buf = cout.rdbuf(&reader);
+        istringstream goArgs(limit);
+        TimePoint start = now();
+        go(pos, goArgs, states);
+        Threads.main()->wait_for_search_finished();
+        TimePoint elapsed = now() - start;
+        cout.rdbuf(buf);
+
+        nodes += Threads.nodes_searched();
+        totalTime += elapsed;
+
+        // The first iteration with a correct move, and the one since which the
+        // move was always correct.
+        auto& its = reader.iterations;
+        auto found = find_if(its.begin(), its.end(), [&](const InfoReader::Iteration& it) { return correct(it.move); });
+        auto held = find_if(its.rbegin(), its.rend(), [&](const InfoReader::Iteration& it) { return !correct(it.move); }).base();
+        bool ok = correct(reader.bestMove) && held != its.end();
+
+        cerr << setw(4) << i + 1 << '/' << records.size() << "  "
+             << left << setw(16) << (r.id.empty() ? "-" : r.id) << right
+             << (ok ? "  solved " : "  failed ") << " bestmove " << setw(6) << reader.bestMove;
+
+        if (ok)
+        {
+            ++solved;
+            solveTime += held->time;
+            cerr << "  depth " << setw(3) << held->depth << "  time " << setw(7) << held->time << " ms";
+
+            if (found != held)
+                cerr << "  (first found at depth " << found->depth << ", " << found->time << " ms)";
+        }
+        cerr << endl;
+    }
+
+    cerr << "\n==========================="
+         << "\nSolved          : " << solved << '/' << records.size()
+         << "\nTotal time (ms) : " << totalTime
+         << "\nSolve time (ms) : " << solveTime
+         << "\nNodes searched  : " << nodes << endl;
+  }
+
+  // cleartime() times a Search::clear(), as run on 'ucinewgame', and then the
+  // reset of the thread data alone, which all the threads do in parallel.
+
+  void cleartime() {
+
+    typedef std::chrono::steady_clock Clock;
+
+    Clock::time_point start = Clock::now();
+    Search::clear();
+    Clock::time_point mid = Clock::now();
+    Threads.clear();
+    Clock::time_point end = Clock::now();
+
+    sync_cout << fixed << setprecision(3)
+              << "Threads        : " << Threads.size()
+              << "\nSearch::clear  : " << std::chrono::duration<double, std::milli>(mid - start).count() << " ms"
+              << "\nThreads.clear  : " << std::chrono::duration<double, std::milli>(end - mid).count() << " ms"
+              << sync_endl;
+  }
+
+  // dbgstats() prints the Dbg probes summed over the threads, or resets them
+  // with 'dbgstats clear'.
+
+  void dbgstats(istream& is) {
+
+    string token;
+
+    if (is >> token && token == "clear")
+        Dbg::clear();
+    else
+        sync_cout << Dbg::report() << sync_endl;
+  }
+
+  // cluster() runs the 'cluster listen', 'cluster connect' and 'cluster bench'
+  // commands, see cluster.cpp.
+
+  void cluster(Position& pos, istream& is, StateListPtr& states) {
+
+    string token;
+    is >> token;
+
+    if (token == "listen")       Cluster::listen(is);
+    else if (token == "connect") Cluster::connect(is);
+    else if (token == "bench")   Cluster::bench(pos, is, states);
+    else
+        sync_cout << "Unknown cluster command: " << token << sync_endl;
+  }
+
+  // pack() writes the positions selected by the bench arguments following the
+  // file name as PackedPosition records, and compares the time to set up and
+  // write back each position as a FEN string and in the packed format.
+
+  void pack(const Position& current, istream& args) {
+
+    typedef std::chrono::steady_clock Clock;
+
+    string fileName;
+    vector<string> fens;
+    vector<PackedPosition> packed;
+    StateInfo st;
+    Position pos;
+    size_t check = 0;
+
+    args >> fileName;
+
+    for (const string& cmd : setup_bench(current, args))
+        if (cmd.find("position fen ") == 0)
+            fens.push_back(cmd.substr(13));
+
+    // Bench positions may be followed by moves, so play them before packing
+    for (string& fen : fens)
+    {
+        StateListPtr states(new std::deque<StateInfo>(1));
+        istringstream is(fen);
+        string token, move;
+
+        fen.clear();
+        while (is >> token && token != "moves")
+            fen += token + " ";
+
+        pos.set(fen, Options["UCI_Chess960"], &states->back(), Threads.main());
+
+        while (is >> move)
+        {
+            states->emplace_back();
+            pos.do_move(UCI::to_move(pos, move), states->back());
+        }
+
+        packed.push_back(pos.pack());
+        fen = pos.fen();
+    }
+
+    ofstream file(fileName, ios::binary);
+    file.write(reinterpret_cast<const char*>(packed.data()), packed.size() * sizeof(PackedPosition));
+
+    if (!file)
+    {
+        sync_cout << "Unable to write file " << fileName << sync_endl;
+        return;
+    }
+
+    constexpr int Rounds = 2000;
+
+    Clock::time_point start = Clock::now();
+    for (int r = 0; r < Rounds; ++r)
+        for (const string& fen : fens)
+            check += pos.set(fen, false, &st, nullptr).fen().size();
+
+    Clock::time_point mid = Clock::now();
+    for (int r = 0; r < Rounds; ++r)
+        for (const PackedPosition& pp : packed)
+        {
+            pos.set_packed(pp, false, &st, nullptr);
+            check += pos.pack().rule50;
+        }
+
+    Clock::time_point end = Clock::now();
+    double n = double(Rounds) * std::max(fens.size(), size_t(1));
+
+    sync_cout << fixed << setprecision(1)
+              << "Positions      : " << fens.size() << " (" << packed.size() * sizeof(PackedPosition)
+              << " bytes written to " << fileName << ")"
+              << "\nset() + fen()  : " << std::chrono::duration<double, std::nano>(mid - start).count() / n << " ns/position"
+              << "\nset_packed() + pack() : " << std::chrono::duration<double, std::nano>(end - mid).count() / n << " ns/position"
+              << "\nChecksum       : " << check << sync_endl;
+  }
+
 } // namespace
 
 
@@ -211,6 +696,10 @@ void UCI::loop(int argc, char* argv[]) {
       token.clear(); // Avoid a stale if getline() returns empty or blank line
       is >> skipws >> token;
 
+      // The main process of a cluster sends the commands to its workers as well
+      if (Cluster::Active)
+          Cluster::forward(cmd);
+
       if (    token == "quit"
           ||  token == "stop")
           Threads.stop = true;
@@ -229,7 +718,7 @@ void UCI::loop(int argc, char* argv[]) {
 
       else if (token == "setoption")  setoption(is);
       else if (token == "go")         go(pos, is, states);
-      else if (token == "position")   position(pos, is, states);
+      else if (token == "position")   UCI::position(pos, is, states);
       else if (token == "ucinewgame") Search::clear();
       else if (token == "isready")    sync_cout << "readyok" << sync_endl;
 
@@ -237,9 +726,23 @@ void UCI::loop(int argc, char* argv[]) {
       // Do not use these commands during a search!
       else if (token == "flip")     pos.flip();
       else if (token == "bench")    bench(pos, is, states);
+      else if (token == "perfbench") perfbench(pos, is, states);
+      else if (token == "epd")      epd(pos, is, states);
+      else if (token == "server")   Server::run(is);
+      else if (token == "cluster")  cluster(pos, is, states);
       else if (token == "d")        sync_cout << pos << sync_endl;
       else if (token == "eval")     sync_cout << Eval::trace(pos) << sync_endl;
       else if (token == "compiler") sync_cout << compiler_info() << sync_endl;
+      else if (token == "hashstats") sync_cout << Pawns::stats() << sync_endl;
+      else if (token == "startup")  sync_cout << startup_report() << sync_endl;
+      else if (token == "magics")   sync_cout << Bitboards::magics_benchmark() << sync_endl;
+      else if (token == "footprint") sync_cout << footprint_report() << "\n\n" << Threads.footprint() << sync_endl;
+      else if (token == "cleartime") cleartime();
+      else if (token == "pack")     pack(pos, is);
+      else if (token == "analyze")  PGN::analyze(is);
+      else if (token == "gensfen")  gensfen(is);
+      else if (token == "stats")    sync_cout << Search::stats() << sync_endl;
+      else if (token == "dbgstats") dbgstats(is);
       else
           sync_cout << "Unknown command: " << cmd << sync_endl;
 
@@ -247,6 +750,100 @@ void UCI::loop(int argc, char* argv[]) {
 }
 
 
+/// UCI::position() is called when engine receives the "position" UCI command.
+/// The function sets up the position described in the given FEN string ("fen")
+/// or the starting position ("startpos") and then makes the moves given in the
+/// following move list ("moves").
+
+void UCI::position(Position& pos, istream& is, StateListPtr& states) {
+
+  Move m;
+  string token, fen;
+
+  is >> token;
+
+  if (token == "startpos")
+  {
+      fen = StartFEN;
+      is >> token; // Consume "moves" token if any
+  }
+  else if (token == "fen")
+      while (is >> token && token != "moves")
+          fen += token + " ";
+  else if (token == "packed")
+  {
+      // A PackedPosition in hex, see UCI::packed(). A bad record leaves the
+      // current position unchanged.
+      PackedPosition pp;
+      uint8_t* bytes = reinterpret_cast<uint8_t*>(&pp);
+      StateListPtr newStates(new std::deque<StateInfo>(1));
+
+      is >> token;
+      bool ok =   token.size() == 2 * sizeof(pp)
+               && token.find_first_not_of("0123456789abcdef") == string::npos;
+
+      for (size_t i = 0; ok && i < sizeof(pp); ++i)
+          bytes[i] = uint8_t(std::stoi(token.substr(2 * i, 2), nullptr, 16));
+
+      if (!ok || !pos.set_packed(pp, Options["UCI_Chess960"], &newStates->back(), Threads.main()))
+      {
+          sync_cout << "info string Invalid packed position" << sync_endl;
+          return;
+      }
+
+      states = std::move(newStates);
+      is >> token; // Consume "moves" token if any
+  }
+  else
+      return;
+
+  if (!fen.empty())
+  {
+      states = StateListPtr(new std::deque<StateInfo>(1)); // Drop old and create a new one
+      pos.set(fen, Options["UCI_Chess960"], &states->back(), Threads.main());
+  }
+
+  // Parse move list (if any)
+  while (is >> token && (m = UCI::to_move(pos, token)) != MOVE_NONE)
+  {
+      states->emplace_back();
+      pos.do_move(m, states->back());
+  }
+}
+
+
+/// UCI::limits() reads the arguments of the "go" UCI command: the thinking time
+/// and the other search limits, and whether the search starts in ponder mode.
+
+Search::LimitsType UCI::limits(const Position& pos, istream& is, bool& ponderMode) {
+
+  Search::LimitsType limits;
+  string token;
+
+  limits.startTime = now(); // As early as possible!
+
+  while (is >> token)
+      if (token == "searchmoves")
+          while (is >> token)
+              limits.searchmoves.push_back(UCI::to_move(pos, token));
+
+      else if (token == "wtime")     is >> limits.time[WHITE];
+      else if (token == "btime")     is >> limits.time[BLACK];
+      else if (token == "winc")      is >> limits.inc[WHITE];
+      else if (token == "binc")      is >> limits.inc[BLACK];
+      else if (token == "movestogo") is >> limits.movestogo;
+      else if (token == "depth")     is >> limits.depth;
+      else if (token == "nodes")     is >> limits.nodes;
+      else if (token == "movetime")  is >> limits.movetime;
+      else if (token == "mate")      is >> limits.mate;
+      else if (token == "perft")     is >> limits.perft;
+      else if (token == "infinite")  limits.infinite = 1;
+      else if (token == "ponder")    ponderMode = true;
+
+  return limits;
+}
+
+
 /// UCI::value() converts a Value to a string suitable for use with the UCI
 /// protocol specification:
 ///
@@ -276,6 +873,22 @@ std::string UCI::square(Square s) {
 }
 
 
+/// UCI::packed() converts a PackedPosition to a string of hex digits, two per
+/// byte in memory order, which "position packed" reads back.
+
+std::string UCI::packed(const PackedPosition& pp) {
+
+  const char* Digits = "0123456789abcdef";
+  const uint8_t* bytes = reinterpret_cast<const uint8_t*>(&pp);
+  std::string str;
+
+  for (size_t i = 0; i < sizeof(pp); ++i)
+      str += { Digits[bytes[i] >> 4], Digits[bytes[i] & 0xF] };
+
+  return str;
+}
+
+
 /// UCI::move() converts a Move to a string in coordinate notation (g1f3, a7a8q).
 /// The only special case is castling, where we print in the e1g1 notation in
 /// normal chess mode, and in e1h1 notation in chess960 mode. Internally all
@@ -21,13 +21,14 @@
 #ifndef UCI_H_INCLUDED
 #define UCI_H_INCLUDED
 
+#include <istream>
 #include <map>
 #include <string>
 
+#include "position.h"
+#include "search.h"
 #include "types.h"
 
-class Position;
-
 namespace UCI {
 
 class Option;
@@ -72,8 +73,11 @@ void loop(int argc, char* argv[]);
 std::string value(Value v);
 std::string square(Square s);
 std::string move(Move m, bool chess960);
+std::string packed(const PackedPosition& pp);
 std::string pv(const Position& pos, Depth depth, Value alpha, Value beta);
 Move to_move(const Position& pos, std::string& str);
+void position(Position& pos, std::istream& is, StateListPtr& states);
+Search::LimitsType limits(const Position& pos, std::istream& is, bool& ponderMode);
 
 } // namespace UCI
 
@@ -23,7 +23,9 @@
 #include <ostream>
 #include <sstream>
 
+#include "mate.h"
 #include "misc.h"
+#include "pawns.h"
 #include "search.h"
 #include "thread.h"
 #include "tt.h"
@@ -40,7 +42,9 @@ namespace UCI {
 void on_clear_hash(const Option&) { Search::clear(); }
 void on_hash_size(const Option& o) { TT.resize(o); }
 void on_logger(const Option& o) { start_logger(o); }
-void on_threads(const Option& o) { Threads.set(o); }
+void on_mate_hash(const Option&) { Mate::clear(); }
+void on_pawn_hash(const Option&) { Pawns::resize(); }
+void on_threads(const Option&) { Threads.set(Options["Threads"]); }
 void on_tb_path(const Option& o) { Tablebases::init(o); }
 
 
@@ -58,13 +62,18 @@ void init(OptionsMap& o) {
 
   // at most 2^32 clusters.
   constexpr int MaxHashMB = Is64Bit ? 131072 : 2048;
+  constexpr int MaxThreads = SingleThread ? 1 : 512;
 
   o["Debug Log File"]        << Option("", on_logger);
   o["Contempt"]              << Option(24, -100, 100);
   o["Analysis Contempt"]     << Option("Both var Off var White var Black var Both", "Both");
-  o["Threads"]               << Option(1, 1, 512, on_threads);
+  o["Threads"]               << Option(1, 1, MaxThreads, on_threads);
+  o["Threads per History"]   << Option(1, 1, MaxThreads, on_threads);
   o["Hash"]                  << Option(16, 1, MaxHashMB, on_hash_size);
   o["Clear Hash"]            << Option(on_clear_hash);
+  o["Pawn Hash"]             << Option(16, 1, 1024, on_pawn_hash);
+  o["Pawn Hash Shared"]      << Option(false, on_pawn_hash);
+  o["Mate Hash"]             << Option(16, 1, MaxHashMB, on_mate_hash);
   o["Ponder"]                << Option(false);
   o["MultiPV"]               << Option(1, 1, 500);
   o["Skill Level"]           << Option(20, 0, 20);
@@ -72,6 +81,7 @@ void init(OptionsMap& o) {
   o["Minimum Thinking Time"] << Option(20, 0, 5000);
   o["Slow Mover"]            << Option(84, 10, 1000);
   o["nodestime"]             << Option(0, 0, 10000);
+  o["Info Interval"]         << Option(0, 0, 10000);
   o["UCI_Chess960"]          << Option(false);
   o["UCI_AnalyseMode"]       << Option(false);
   o["UCI_LimitStrength"]     << Option(false);
@@ -133,8 +143,7 @@ Option::operator double() const {
 }
 
 Option::operator std::string() const {
-  assert(type == "string");
-  return currentValue;
+  return currentValue; // Any type, e.g. to restore the value later
 }
 
 bool Option::operator==(const char* s) const {